@@ -0,0 +1,335 @@
+#include "Deflate.hpp"
+
+#include <algorithm>
+#include <queue>
+
+static const int MIN_MATCH = 3;
+static const int MAX_MATCH = 258;
+static const size_t MAX_DISTANCE = 32768;
+static const size_t BLOCK_TOKENS = 1 << 16;
+
+static const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// A literal has distance 0, a match stores its length in `value`.
+struct Token
+{
+    uint16_t value;
+    uint16_t distance;
+};
+
+class BitOutput
+{
+public:
+    std::vector<uint8_t> bytes;
+
+    void Put(uint32_t bits, int count) {
+        buffer |= (uint64_t)bits << filled;
+        filled += count;
+        while (filled >= 8) {
+            bytes.push_back((uint8_t)buffer);
+            buffer >>= 8;
+            filled -= 8;
+        }
+    }
+
+    void Flush() {
+        if (filled > 0) {
+            bytes.push_back((uint8_t)buffer);
+        }
+        buffer = 0;
+        filled = 0;
+    }
+
+private:
+    uint64_t buffer = 0;
+    int filled = 0;
+};
+
+static int LengthSymbol(int length) {
+    static uint8_t table[MAX_MATCH + 1];
+    static bool tableReady = false;
+    if (!tableReady) {
+        int code = 0;
+        for (int len = MIN_MATCH; len <= MAX_MATCH; len++) {
+            while (code < 28 && LENGTH_BASE[code + 1] <= len) code++;
+            table[len] = (uint8_t)code;
+        }
+        tableReady = true;
+    }
+    return table[length];
+}
+
+static int DistanceSymbol(int distance) {
+    int code = 0;
+    while (code < 29 && DIST_BASE[code + 1] <= distance) {
+        code++;
+    }
+    return code;
+}
+
+// Huffman code lengths no longer than `limit`. Frequencies are flattened
+// and the tree rebuilt until it fits.
+static void BuildLengths(std::vector<uint32_t> freq, int limit, std::vector<uint8_t> &lengths) {
+    int n = (int)freq.size();
+    lengths.assign(n, 0);
+
+    while (true) {
+        std::vector<int> parent(2 * n, -1);
+        std::priority_queue<std::pair<uint64_t, int>, std::vector<std::pair<uint64_t, int>>, std::greater<>> heap;
+        for (int i = 0; i < n; i++) {
+            if (freq[i] > 0) heap.push({freq[i], i});
+        }
+
+        int next = n;
+        while (heap.size() > 1) {
+            auto a = heap.top(); heap.pop();
+            auto b = heap.top(); heap.pop();
+            parent[a.second] = next;
+            parent[b.second] = next;
+            heap.push({a.first + b.first, next});
+            next++;
+        }
+
+        int longest = 0;
+        for (int i = 0; i < n; i++) {
+            if (freq[i] == 0) continue;
+            int depth = 0;
+            for (int p = parent[i]; p != -1; p = parent[p]) depth++;
+            lengths[i] = (uint8_t)std::max(depth, 1);
+            longest = std::max(longest, (int)lengths[i]);
+        }
+        if (longest <= limit) {
+            return;
+        }
+        for (uint32_t &f : freq) {
+            if (f > 0) f = (f + 1) / 2;
+        }
+    }
+}
+
+// Canonical codes, bit-reversed because deflate sends them MSB first.
+static void BuildCodes(const std::vector<uint8_t> &lengths, std::vector<uint16_t> &codes) {
+    int count[16] = {0};
+    for (uint8_t l : lengths) count[l]++;
+    count[0] = 0;
+
+    int nextCode[16] = {0};
+    int code = 0;
+    for (int bits = 1; bits < 16; bits++) {
+        code = (code + count[bits - 1]) << 1;
+        nextCode[bits] = code;
+    }
+
+    codes.assign(lengths.size(), 0);
+    for (size_t i = 0; i < lengths.size(); i++) {
+        int len = lengths[i];
+        if (len == 0) continue;
+        int c = nextCode[len]++;
+        int reversed = 0;
+        for (int b = 0; b < len; b++) {
+            reversed = (reversed << 1) | ((c >> b) & 1);
+        }
+        codes[i] = (uint16_t)reversed;
+    }
+}
+
+// Deflate rejects trees with fewer than two codes in some decoders.
+static void EnsureTwoSymbols(std::vector<uint32_t> &freq) {
+    int used = 0;
+    for (uint32_t f : freq) used += f > 0;
+    for (size_t i = 0; used < 2 && i < freq.size(); i++) {
+        if (freq[i] == 0) {
+            freq[i] = 1;
+            used++;
+        }
+    }
+}
+
+struct LengthRun
+{
+    uint8_t symbol;
+    uint8_t extra;
+};
+
+static void RunLengthEncode(const std::vector<uint8_t> &lengths, std::vector<LengthRun> &runs) {
+    size_t i = 0;
+    while (i < lengths.size()) {
+        uint8_t value = lengths[i];
+        size_t run = 1;
+        while (i + run < lengths.size() && lengths[i + run] == value) run++;
+        i += run;
+
+        if (value == 0) {
+            while (run >= 11) {
+                size_t take = std::min<size_t>(run, 138);
+                runs.push_back({18, (uint8_t)(take - 11)});
+                run -= take;
+            }
+            if (run >= 3) {
+                runs.push_back({17, (uint8_t)(run - 3)});
+                run = 0;
+            }
+        }
+        else {
+            runs.push_back({value, 0});
+            run--;
+            while (run >= 3) {
+                size_t take = std::min<size_t>(run, 6);
+                runs.push_back({16, (uint8_t)(take - 3)});
+                run -= take;
+            }
+        }
+        for (; run > 0; run--) {
+            runs.push_back({value, 0});
+        }
+    }
+}
+
+static void WriteBlock(BitOutput &out, const std::vector<Token> &tokens, bool last) {
+    std::vector<uint32_t> litFreq(286, 0), distFreq(30, 0);
+    for (const Token &t : tokens) {
+        if (t.distance == 0) {
+            litFreq[t.value]++;
+        }
+        else {
+            litFreq[257 + LengthSymbol(t.value)]++;
+            distFreq[DistanceSymbol(t.distance)]++;
+        }
+    }
+    litFreq[256] = 1;
+    EnsureTwoSymbols(litFreq);
+    EnsureTwoSymbols(distFreq);
+
+    std::vector<uint8_t> litLengths, distLengths;
+    BuildLengths(litFreq, 15, litLengths);
+    BuildLengths(distFreq, 15, distLengths);
+
+    int hlit = 286, hdist = 30;
+    while (hlit > 257 && litLengths[hlit - 1] == 0) hlit--;
+    while (hdist > 1 && distLengths[hdist - 1] == 0) hdist--;
+
+    std::vector<uint8_t> allLengths(litLengths.begin(), litLengths.begin() + hlit);
+    allLengths.insert(allLengths.end(), distLengths.begin(), distLengths.begin() + hdist);
+    std::vector<LengthRun> runs;
+    RunLengthEncode(allLengths, runs);
+
+    std::vector<uint32_t> clFreq(19, 0);
+    for (const LengthRun &r : runs) clFreq[r.symbol]++;
+    EnsureTwoSymbols(clFreq);
+    std::vector<uint8_t> clLengths;
+    BuildLengths(clFreq, 7, clLengths);
+    std::vector<uint16_t> clCodes, litCodes, distCodes;
+    BuildCodes(clLengths, clCodes);
+    BuildCodes(litLengths, litCodes);
+    BuildCodes(distLengths, distCodes);
+
+    int hclen = 19;
+    while (hclen > 4 && clLengths[CODE_LENGTH_ORDER[hclen - 1]] == 0) hclen--;
+
+    out.Put(last ? 1 : 0, 1);
+    out.Put(2, 2);
+    out.Put(hlit - 257, 5);
+    out.Put(hdist - 1, 5);
+    out.Put(hclen - 4, 4);
+    for (int i = 0; i < hclen; i++) {
+        out.Put(clLengths[CODE_LENGTH_ORDER[i]], 3);
+    }
+    for (const LengthRun &r : runs) {
+        out.Put(clCodes[r.symbol], clLengths[r.symbol]);
+        if (r.symbol == 16) out.Put(r.extra, 2);
+        if (r.symbol == 17) out.Put(r.extra, 3);
+        if (r.symbol == 18) out.Put(r.extra, 7);
+    }
+
+    for (const Token &t : tokens) {
+        if (t.distance == 0) {
+            out.Put(litCodes[t.value], litLengths[t.value]);
+            continue;
+        }
+        int ls = LengthSymbol(t.value);
+        out.Put(litCodes[257 + ls], litLengths[257 + ls]);
+        out.Put(t.value - LENGTH_BASE[ls], LENGTH_EXTRA[ls]);
+        int ds = DistanceSymbol(t.distance);
+        out.Put(distCodes[ds], distLengths[ds]);
+        out.Put(t.distance - DIST_BASE[ds], DIST_EXTRA[ds]);
+    }
+    out.Put(litCodes[256], litLengths[256]);
+}
+
+static size_t MatchLength(const uint8_t *data, size_t pos, size_t distance, size_t limit) {
+    const uint8_t *a = data + pos;
+    const uint8_t *b = a - distance;
+    size_t len = 0;
+    while (len < limit && a[len] == b[len]) len++;
+    return len;
+}
+
+static uint32_t Adler32(const uint8_t *data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t chunk = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < chunk; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += chunk;
+        size -= chunk;
+    }
+    return (b << 16) | a;
+}
+
+std::vector<uint8_t> ZlibCompressRows(const uint8_t *data, size_t size, size_t rowDistance) {
+    BitOutput out;
+    out.Put(0x78, 8);
+    out.Put(0x01, 8);
+
+    bool useRows = rowDistance > 1 && rowDistance <= MAX_DISTANCE;
+    std::vector<Token> tokens;
+    tokens.reserve(BLOCK_TOKENS);
+
+    size_t pos = 0;
+    while (pos < size) {
+        size_t limit = std::min<size_t>(MAX_MATCH, size - pos);
+        size_t best = 0, bestDistance = 0;
+        if (pos >= 1) {
+            best = MatchLength(data, pos, 1, limit);
+            bestDistance = 1;
+        }
+        if (useRows && pos >= rowDistance && best < limit) {
+            size_t len = MatchLength(data, pos, rowDistance, limit);
+            if (len > best) {
+                best = len;
+                bestDistance = rowDistance;
+            }
+        }
+
+        if (best >= (size_t)MIN_MATCH) {
+            tokens.push_back({(uint16_t)best, (uint16_t)bestDistance});
+            pos += best;
+        }
+        else {
+            tokens.push_back({data[pos], 0});
+            pos++;
+        }
+
+        if (tokens.size() == BLOCK_TOKENS && pos < size) {
+            WriteBlock(out, tokens, false);
+            tokens.clear();
+        }
+    }
+    WriteBlock(out, tokens, true);
+    out.Flush();
+
+    uint32_t adler = Adler32(data, size);
+    out.bytes.push_back((uint8_t)(adler >> 24));
+    out.bytes.push_back((uint8_t)(adler >> 16));
+    out.bytes.push_back((uint8_t)(adler >> 8));
+    out.bytes.push_back((uint8_t)adler);
+    return std::move(out.bytes);
+}
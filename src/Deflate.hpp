@@ -0,0 +1,15 @@
+#ifndef DEFLATE_HPP
+#define DEFLATE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// zlib stream (RFC 1950/1951) tuned for filtered scanlines of block images.
+// Instead of a hash chain it only tries two match candidates: the previous
+// byte (runs of one value, e.g. the zeros of Sub/Up filtered flat areas) and
+// the same byte one row earlier (`rowDistance`, rows that repeat their
+// predecessor). Tokens are coded with per-block dynamic Huffman tables.
+std::vector<uint8_t> ZlibCompressRows(const uint8_t *data, size_t size, size_t rowDistance);
+
+#endif
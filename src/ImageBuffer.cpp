@@ -0,0 +1,50 @@
+#include "ImageBuffer.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+ImageBuffer::ImageBuffer(ImageBuffer &&other) noexcept {
+    *this = std::move(other);
+}
+
+ImageBuffer &ImageBuffer::operator=(ImageBuffer &&other) noexcept {
+    width = other.width;
+    height = other.height;
+    channels = other.channels;
+    stride = other.stride;
+    storage = std::move(other.storage);
+    capacity = std::exchange(other.capacity, 0);
+    data = std::exchange(other.data, nullptr);
+    return *this;
+}
+
+void ImageBuffer::Resize(int width, int height) {
+    this->width = width;
+    this->height = height;
+    channels = 3;
+    stride = ((size_t)width * 3 + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    size_t size = stride * height;
+    if (size > capacity) {
+        uint8_t *block = (uint8_t *)malloc(size + ALIGNMENT - 1);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        storage = std::unique_ptr<uint8_t, void (*)(void *)>(block, free);
+        capacity = size;
+        uintptr_t base = (uintptr_t)block;
+        data = block + (ALIGNMENT - base % ALIGNMENT) % ALIGNMENT;
+    }
+}
+
+void ImageBuffer::Adopt(uint8_t *pixels, int width, int height, int channels, size_t stride, void (*deleter)(void *)) {
+    this->width = width;
+    this->height = height;
+    this->channels = channels;
+    this->stride = stride;
+    storage = std::unique_ptr<uint8_t, void (*)(void *)>(pixels, deleter);
+    // Not aligned, so Resize has to allocate again.
+    capacity = 0;
+    data = pixels;
+}
@@ -0,0 +1,45 @@
+#ifndef IMAGE_BUFFER_HPP
+#define IMAGE_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Interleaved 8-bit image with `channels` bytes per pixel (3 = RGB,
+// 4 = RGBA, the alpha byte is ignored) and rows `stride` bytes apart.
+//
+// Resize allocates an RGB image whose rows start on 64-byte boundaries, so
+// it can go straight to the encoders (which all take a stride) without
+// being repacked. It keeps the allocation when it is already large enough,
+// so one buffer can serve every pass of the threshold search.
+//
+// Adopt takes ownership of a buffer allocated elsewhere, e.g. by a decoder,
+// together with the function that frees it.
+class ImageBuffer
+{
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    int width = 0, height = 0;
+    int channels = 3;
+    size_t stride = 0;
+
+    ImageBuffer() = default;
+    ImageBuffer(ImageBuffer &&other) noexcept;
+    ImageBuffer &operator=(ImageBuffer &&other) noexcept;
+
+    void Resize(int width, int height);
+    void Adopt(uint8_t *pixels, int width, int height, int channels, size_t stride, void (*deleter)(void *));
+
+    uint8_t *Data() { return data; }
+    const uint8_t *Data() const { return data; }
+    uint8_t *Row(int y) { return data + (size_t)y * stride; }
+    const uint8_t *Row(int y) const { return data + (size_t)y * stride; }
+
+private:
+    std::unique_ptr<uint8_t, void (*)(void *)> storage{nullptr, nullptr};
+    size_t capacity = 0;
+    uint8_t *data = nullptr;
+};
+
+#endif
@@ -6,74 +6,195 @@
 
 #include "gifenc.h"
 #include "QuadTree.hpp"
+#include "QuadTreeCodec.hpp"
+#include "QuadTreeImage.hpp"
+#include "TiledQuadTree.hpp"
+#include "LeafPalette.hpp"
+#include "JpegWriter.hpp"
+#include "PngWriter.hpp"
 #include "Metrics.hpp"
+#include "ImageBuffer.hpp"
 #include "ImageLoadException.hpp"
 
 #include "gif-library/iff2gif/neuquant.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <iomanip>
 #include <sys/stat.h>
 #include <chrono>
+#include <climits>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_map>
+#include <new>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// Formats with a row source (PPM, non-interlaced PNG) are decoded row by row
+// straight into an RGB buffer, without stb's intermediate copy of the whole
+// inflated stream. Everything else is decoded by stb from a memory mapping of
+// the file. Standard input ("-") and pipes can only be read once, so they are
+// read into memory and handed to stb directly. Images decoded by stb are
+// adopted as they are (3 or 4 channels, the alpha byte is skipped by every
+// reader). Gray and gray-alpha files are expanded to RGB by the decoder
+// itself. Quadtree files are recognized by their header, mapped or piped.
+// fileSize, if given, receives the size of the encoded input.
+static ImageBuffer DecodeImage(const std::string &fileName, int &width, int &height, uint64_t *fileSize) {
+    ImageBuffer image;
+
+    MappedFile file(fileName);
+    if (fileSize) {
+        *fileSize = file.Size();
+    }
 
-std::vector<RGBPixel> LoadImage(std::string fileName, int &width, int &height) {
-    int channels;
-    unsigned char* image_data = stbi_load(fileName.c_str(), &width, &height, &channels, 0);
+    QuadTreeCoding coding;
+    if (IsQuadTreeFile(file, &coding)) {
+        if (coding == QTC_INDEXED) {
+            IndexedQuadTreeFile indexed(file, fileName);
+            width = indexed.Width();
+            height = indexed.Height();
+            std::vector<RGBPixel> pixels = indexed.RenderViewport(0, 0, width, height, width, height);
+            image.Resize(width, height);
+            for (int y = 0; y < height; y++) {
+                memcpy(image.Row(y), &pixels[(size_t)y * width], (size_t)width * 3);
+            }
+            return image;
+        }
 
-    if (!image_data) {
-        throw ImageLoadException("Can't open file: " + fileName);
+        std::unique_ptr<QuadTreeNode> root = DecodeQuadTree(file.Data(), file.Size(), width, height);
+        image.Resize(width, height);
+        reconstructImage(image, root);
+        return image;
     }
 
-    std::vector<RGBPixel> pixels;
-    
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            int index = (i * width + j) * channels;
+    std::unique_ptr<RowSource> source = file.Mapped() ? OpenRowSource(fileName) : nullptr;
+    if (source) {
+        width = source->Width();
+        height = source->Height();
+        image.Resize(width, height);
+        source->ReadRows(image.Data(), image.stride, height);
+        return image;
+    }
 
-            uint8_t r = image_data[index + 0];
-            uint8_t g = image_data[index + 1];
-            uint8_t b = image_data[index + 2];
+    if (file.Size() > INT_MAX) {
+        throw ImageLoadException("File too large to decode: " + fileName);
+    }
+    file.AdviseSequential();
 
-            pixels.emplace_back(RGBPixel(r, g, b));
-        }
+    int channels;
+    if (!stbi_info_from_memory(file.Data(), (int)file.Size(), &width, &height, &channels)) {
+        throw ImageLoadException("Can't open file: " + fileName);
     }
+    int requested = channels < 3 ? 3 : 0;
 
-    return pixels;
-}
+    unsigned char* image_data = stbi_load_from_memory(file.Data(), (int)file.Size(), &width, &height, &channels, requested);
+
+    if (!image_data) {
+        throw ImageLoadException("Can't open file: " + fileName);
+    }
+    if (requested) {
+        channels = requested;
+    }
 
-void SaveImage(std::string fileName, const std::vector<RGBPixel> &image, int &width, int &height, bool show) {
-    std::vector<uint8_t> rawData;
-    rawData.reserve(width * height * 3);
+    image.Adopt(image_data, width, height, channels, (size_t)width * channels, stbi_image_free);
+    return image;
+}
 
-    for (const auto& pixel : image) {
-        rawData.push_back(pixel.r);
-        rawData.push_back(pixel.g);
-        rawData.push_back(pixel.b);
+// A header can claim dimensions far beyond what fits in memory; that is
+// reported like any other unreadable input instead of escaping as bad_alloc.
+ImageBuffer LoadImage(std::string fileName, int &width, int &height, uint64_t *fileSize = nullptr) {
+    width = height = 0;
+    try {
+        return DecodeImage(fileName, width, height, fileSize);
+    }
+    catch (const std::bad_alloc &) {
+        std::string size = width > 0 ? " (" + std::to_string(width) + "x" + std::to_string(height) + ")" : "";
+        throw ImageLoadException("Not enough memory to decode " + fileName + size);
     }
+}
 
+std::string GetExtension(const std::string &fileName) {
     std::string ext = fileName.substr(fileName.find_last_of('.') + 1);
     for (int i = 0; ext[i] != '\0'; ++i) {
         if ('A' <= ext[i] && ext[i] <= 'Z') {
             ext[i] += 32;
         }
     }
+    return ext;
+}
 
-    bool success = false;
+static void WriteToStream(void *context, void *data, int size) {
+    static_cast<std::ostream *>(context)->write((const char *)data, size);
+}
+
+// Output formats, selected by file extension.
+bool IsOutputExtension(const std::string &ext) {
+    return ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "qtc" || ext == "qtz" || ext == "qtp" || ext == "qti";
+}
 
+// Encodes the image (or the tree, for the quadtree formats) as `ext` into
+// `out`. leafPalette: -1 for a truecolor PNG, otherwise the QUANTIZER_* used
+// to reduce the leaf colors to an 8-bit palette PNG.
+bool WriteImage(std::ostream &out, const std::string &ext, const ImageBuffer &image, std::unique_ptr<QuadTreeNode> &root, int width, int height, int leafPalette) {
+    if (ext == "png" && leafPalette >= 0) {
+        std::vector<RGBPixel> palette;
+        std::vector<uint8_t> indices = QuantizeLeaves(root, width, height, leafPalette, palette);
+        return WriteIndexedPng(out, indices.data(), width, height, palette);
+    }
+    if (ext == "png" && root) {
+        return WriteQuadTreePng(out, image.Data(), image.stride, width, height, root);
+    }
     if (ext == "png") {
-        success = stbi_write_png(fileName.c_str(), width, height, 3, rawData.data(), width * 3);
+        return stbi_write_png_to_func(WriteToStream, &out, width, height, 3, image.Data(), (int)image.stride) && out;
+    }
+    if ((ext == "jpg" || ext == "jpeg") && root) {
+        return WriteQuadTreeJpeg(out, image.Data(), image.stride, width, height, root, 100);
     }
-    else if (ext == "jpg" || ext == "jpeg") {
+    if (ext == "jpg" || ext == "jpeg") {
+        // stb's JPEG writer only takes packed rows.
+        std::vector<uint8_t> rawData((size_t)width * height * 3);
+        for (int y = 0; y < height; y++) {
+            memcpy(&rawData[(size_t)y * width * 3], image.Row(y), (size_t)width * 3);
+        }
         int quality = 100;
-        success = stbi_write_jpg(fileName.c_str(), width, height, 3, rawData.data(), quality);
+        return stbi_write_jpg_to_func(WriteToStream, &out, width, height, 3, rawData.data(), quality) && out;
     }
-    else {
+    if (ext == "qtc") {
+        return EncodeQuadTree(out, root, width, height, QTC_RAW);
+    }
+    if (ext == "qtz") {
+        return EncodeQuadTree(out, root, width, height, QTC_RANGE);
+    }
+    if (ext == "qtp") {
+        return EncodeQuadTree(out, root, width, height, QTC_PROGRESSIVE);
+    }
+    if (ext == "qti") {
+        return EncodeQuadTree(out, root, width, height, QTC_INDEXED);
+    }
+    return false;
+}
+
+void SaveImage(std::string fileName, const ImageBuffer &image, std::unique_ptr<QuadTreeNode> &root, int &width, int &height, int leafPalette, bool show) {
+    std::string ext = GetExtension(fileName);
+    if (!IsOutputExtension(ext)) {
         std::cerr << "Unsupported file extension: ." << ext << std::endl;
         return;
     }
 
+    std::ofstream file(fileName, std::ios::binary);
+    bool success = file && WriteImage(file, ext, image, root, width, height, leafPalette);
+
     if(show) {
         if (success) {
             std::cout << "Gambar berhasil disimpan di " << fileName << std::endl;
@@ -83,116 +204,81 @@ void SaveImage(std::string fileName, const std::vector<RGBPixel> &image, int &wi
     }
 }
 
-RGBPixel CalculateAverageColor(const std::vector<RGBPixel> &image, int x, int y, int width, int height, int &imageWidth) {
-    uint32_t r = 0, g = 0, b = 0;
-    for (int i = y; i < y + height; i++)
-    {
-        for (int j = x; j < x + width; j++)
-        {
-            int idx = i * imageWidth + j;
-            r += image[idx].r;
-            g += image[idx].g;
-            b += image[idx].b;
-        }
+// uncompressedSize is the size of the input file as read, which for a pipe
+// can't be known from stat.
+double CalculateCompressionRatio(double uncompressedSize, const std::string &compressedFile, bool show) {
+    struct stat compressedStat;
+    if (stat(compressedFile.c_str(), &compressedStat) != 0) {
+        throw ImageLoadException("Cannot get file size: " + compressedFile);
     }
-    int totalPixel = width * height;
-    return RGBPixel((uint8_t)(r / totalPixel), (uint8_t)(g / totalPixel), (uint8_t)(b / totalPixel));
-}
 
-std::unique_ptr<QuadTreeNode> BuildQuadTree(std::vector<RGBPixel> &image, int x, int y, int w, int h, double threshold, int minBlockSize, int errorMeasurementChoice, int imageWidth) {
-    if(w <= 0 || h <= 0) {
-        return nullptr;
+    double compressedSize = compressedStat.st_size;
+    if (show) {
+        std::cout << "Ukuran Sebelum Kompresi: " << uncompressedSize << " bytes" << std::endl;
+        std::cout << "Ukuran Setelah Kompresi: " << compressedSize << " bytes" << std::endl;
     }
-    
-    RGBPixel avgColor = CalculateAverageColor(image, x, y, w, h, imageWidth);
-    double error;
+    return (1 - (compressedSize / uncompressedSize)) * 100.0;
+}
 
+// Valid threshold range of each error metric.
+void ThresholdRange(int errorMeasurementChoice, double &low, double &high) {
     switch (errorMeasurementChoice)
     {
     case 1:
         // Variance
-        error = CalculateVariance(image, x, y, w, h, avgColor, imageWidth);
+        low = 0; high = 16256.25;
         break;
     case 2:
         // Mean Absolute Deviation (MAD)
-        error = CalculateMeanAbsoluteDeviation(image, x, y, w, h, avgColor, imageWidth);
+        low = 0; high = 127.5;
         break;
     case 3:
         // Max Pixel Difference
-        error = CalculateMaxPixelDifference(image, x, y, w, h, avgColor, imageWidth);
+        low = 0; high = 255;
         break;
 
     case 4:
-        // Entropy
-        error = CalculateEntropy(image, x, y, w, h, avgColor, imageWidth);
+        // Entropy (rentang 0-8)
+        low = 0; high = 8;
         break;
 
     case 5:
-        // SSIM
-        double ssim = CalculateSSIM(image, x, y, w, h, avgColor, imageWidth);
-        error = 1.0 - ssim;
+        // SSIM (rentang 0-1)
+        low = -1; high = 1;
         break;
     }
-
-    if (error < threshold || (w * h) < minBlockSize)
-    {
-        return std::make_unique<QuadTreeNode>(x, y, w, h, avgColor, true);
-    }
-
-    int halfWidth = w / 2;
-    int remWidth = w - halfWidth;
-    int halfHeight = h / 2;
-    int remHeight = h - halfHeight;
-
-    auto node = std::make_unique<QuadTreeNode>(x, y, w, h, avgColor, false);
-    node->atasKiri = BuildQuadTree(image, x, y, halfWidth, halfHeight, threshold, minBlockSize, errorMeasurementChoice, imageWidth);
-    node->atasKanan = BuildQuadTree(image, x + halfWidth, y, remWidth, halfHeight, threshold, minBlockSize, errorMeasurementChoice, imageWidth);
-    node->bawahKiri = BuildQuadTree(image, x, y + halfHeight, halfWidth, remHeight, threshold, minBlockSize, errorMeasurementChoice, imageWidth);
-    node->bawahKanan = BuildQuadTree(image, x + halfWidth, y + halfHeight, remWidth, remHeight, threshold, minBlockSize, errorMeasurementChoice, imageWidth);
-    return node;
 }
 
-void reconstructImage(std::vector<RGBPixel> &outputImage, std::unique_ptr<QuadTreeNode> &node, int &imageWidth) {
-    if (!node)
-    {
-        return;
-    }
+// Binary search on the threshold (with a minimum block of 1) for the tree
+// whose encoding as `ext` comes closest to targetRatio percent. Candidates
+// are encoded in memory; only the image formats need them reconstructed.
+std::unique_ptr<QuadTreeNode> SearchThreshold(const ImageBuffer &image, ImageBuffer &outputImage, const std::string &ext, int leafPalette, double originalSize, double targetRatio, double low, double high, int errorMeasurementChoice) {
+    // Mengasumsikan rasio bergantung sepenuhnya pada threshold
+    std::unique_ptr<QuadTreeNode> root;
+    bool reconstruct = ext == "png" || ext == "jpg" || ext == "jpeg";
 
-    if (node->isLeaf)
-    {
-        for (int i = 0; i < node->height; i++)
-        {
-            for (int j = 0; j < node->width; j++)
-            {
-                int idx = (node->y + i) * imageWidth + (node->x + j);
-                outputImage[idx] = node->color;
-            }
-        }
-        return;
-    }
+    int tempBlockSize = 1;
+    long double L = low, R = high;
 
-    reconstructImage(outputImage, node->atasKiri, imageWidth);
-    reconstructImage(outputImage, node->atasKanan, imageWidth);
-    reconstructImage(outputImage, node->bawahKiri, imageWidth);
-    reconstructImage(outputImage, node->bawahKanan, imageWidth);
-}
+    for (int _ = 0; _ < 20; _++) {
+        long double M = (L + R) / 2.0;
 
-double CalculateCompressionRatio(const std::string &uncompressedFile, const std::string &compressedFile, bool show) {
-    struct stat uncompressedStat, compressedStat;
-    if (stat(uncompressedFile.c_str(), &uncompressedStat) != 0) {
-        throw ImageLoadException("Cannot get file size: " + uncompressedFile);
-    }
-    if (stat(compressedFile.c_str(), &compressedStat) != 0) {
-        throw ImageLoadException("Cannot get file size: " + compressedFile);
-    }
+        root = BuildQuadTree(image, 0, 0, image.width, image.height, M, tempBlockSize, errorMeasurementChoice);
 
-    double uncompressedSize = uncompressedStat.st_size;
-    double compressedSize = compressedStat.st_size;
-    if (show) {
-        std::cout << "Ukuran Sebelum Kompresi: " << uncompressedSize << " bytes" << std::endl;
-        std::cout << "Ukuran Setelah Kompresi: " << compressedSize << " bytes" << std::endl;
+        if (reconstruct) {
+            reconstructImage(outputImage, root);
+        }
+        std::ostringstream encoded;
+        WriteImage(encoded, ext, outputImage, root, image.width, image.height, leafPalette);
+        double compressionRatio = (1 - (double)encoded.tellp() / originalSize) * 100.0;
+        if (compressionRatio < targetRatio) {
+            L = M;
+        }
+        else {
+            R = M;
+        }
     }
-    return (1 - (compressedSize / uncompressedSize)) * 100.0;
+    return root;
 }
 
 int GetMaxDepth(std::unique_ptr<QuadTreeNode> &node) {
@@ -210,7 +296,7 @@ int GetMaxDepth(std::unique_ptr<QuadTreeNode> &node) {
                      GetMaxDepth(node->bawahKanan)}) + 1;
 }
 
-int GetNodeCount(std::unique_ptr<QuadTreeNode> &node) {
+uint64_t GetNodeCount(std::unique_ptr<QuadTreeNode> &node) {
     if (!node) {
         return 0;
     }
@@ -225,106 +311,580 @@ int GetNodeCount(std::unique_ptr<QuadTreeNode> &node) {
            GetNodeCount(node->bawahKanan) + 1;
 }
 
-void SaveGif(const std::string &gifOutputPath, const std::vector<RGBPixel> &image, std::unique_ptr<QuadTreeNode> &root, int imageWidth, int imageHeight) {
-    std::vector<uint8_t> rgbData(image.size() * 3);
-    for (size_t i = 0; i < image.size(); ++i) {
-        rgbData[i * 3 + 0] = image[i].r;
-        rgbData[i * 3 + 1] = image[i].g;
-        rgbData[i * 3 + 2] = image[i].b;
+// The last palette entry is kept free to mark pixels a frame leaves as they
+// were.
+const int GIF_COLORS = 255;
+const uint8_t GIF_TRANSPARENT = 255;
+
+// Which quantizer built the GIF palette, how long it took and its mean
+// absolute error per channel over all frames.
+struct GifPaletteStats
+{
+    std::string quantizer;
+    size_t colors = 0;
+    double milliseconds = 0;
+    double error = 0;
+};
+
+// `quantizer` for SaveGif that builds the palette with every option, reports
+// each, and keeps the one with the smallest error.
+const int GIF_COMPARE_QUANTIZERS = -2;
+
+// The GIF palette is trained on the colors the frames actually show: those
+// of the tree's nodes, every level included. Each color is weighted by the
+// area it covers summed over all frames, so a split block counts once and a
+// leaf once for every frame from its level to the last.
+static std::unordered_map<uint32_t, uint64_t> GifColorAreas(QuadTreeNode *root) {
+    struct Leaf { uint32_t key; uint64_t area; int level; };
+    std::unordered_map<uint32_t, uint64_t> areas;
+    std::vector<Leaf> leaves;
+    std::vector<QuadTreeNode*> level, nextLevel;
+    int levels = 0;
+    if (root) level.push_back(root);
+    for (; !level.empty(); levels++) {
+        for (QuadTreeNode *node : level) {
+            uint32_t key = (uint32_t)node->color.r | ((uint32_t)node->color.g << 8) | ((uint32_t)node->color.b << 16);
+            uint64_t area = (uint64_t)node->width * node->height;
+            if (node->isLeaf) {
+                leaves.push_back({key, area, levels});
+                continue;
+            }
+            areas[key] += area;
+            for (int k = 0; k < 4; k++) {
+                if (node->Child(k)) nextLevel.push_back(node->Child(k).get());
+            }
+        }
+        level.swap(nextLevel);
+        nextLevel.clear();
+    }
+    for (const Leaf &leaf : leaves) {
+        areas[leaf.key] += leaf.area * (levels - leaf.level);
+    }
+    return areas;
+}
+
+// Builds the GIF palette for the weighted colors of GifColorAreas. With at
+// most GIF_COLORS colors the palette is exact whatever the choice of
+// quantizer (one of the iff2gif QUANTIZER_ values, or -1 for exact only,
+// which falls back to MedianCut when there are more colors), unless
+// `forceQuantizer` is set.
+static GifPaletteStats BuildGifPalette(const std::unordered_map<uint32_t, uint64_t> &areas, int quantizer, bool forceQuantizer, uint8_t gifPalette[256 * 3], std::unordered_map<uint32_t, uint8_t> &nearest) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    GifPaletteStats stats;
+    if (areas.size() <= GIF_COLORS && !(forceQuantizer && quantizer >= 0)) {
+        int i = 0;
+        for (const auto &entry : areas) {
+            gifPalette[i * 3 + 0] = (uint8_t)entry.first;
+            gifPalette[i * 3 + 1] = (uint8_t)(entry.first >> 8);
+            gifPalette[i * 3 + 2] = (uint8_t)(entry.first >> 16);
+            nearest[entry.first] = (uint8_t)i++;
+        }
+        stats.quantizer = "exact";
+        stats.colors = areas.size();
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+        return stats;
+    }
+    if (quantizer < 0) {
+        quantizer = QUANTIZER_MedianCut;
+    }
+
+    std::vector<uint64_t> colorAreas;
+    std::vector<uint8_t> colors;
+    uint64_t totalArea = 0;
+    for (const auto &entry : areas) {
+        colors.insert(colors.end(), {(uint8_t)entry.first, (uint8_t)(entry.first >> 8), (uint8_t)(entry.first >> 16), 0});
+        colorAreas.push_back(entry.second);
+        totalArea += entry.second;
+    }
+    std::vector<uint32_t> weights = QuantizerWeights(colorAreas);
+
+    std::unique_ptr<Quantizer> q(QuantizerFactory[quantizer](GIF_COLORS));
+    q->AddWeightedPixels(colors.data(), weights.data(), weights.size());
+    Palette palette = q->GetPalette();
+    for (size_t i = 0; i < std::min(palette.size(), size_t(GIF_COLORS)); ++i) {
+        gifPalette[i * 3 + 0] = palette[i].red;
+        gifPalette[i * 3 + 1] = palette[i].green;
+        gifPalette[i * 3 + 2] = palette[i].blue;
+    }
+
+    double error = 0;
+    for (const auto &entry : areas) {
+        int r = (uint8_t)entry.first, g = (uint8_t)(entry.first >> 8), b = (uint8_t)(entry.first >> 16);
+        uint8_t index = (uint8_t)palette.NearestColor(r, g, b);
+        nearest[entry.first] = index;
+        error += (double)entry.second * (std::abs(r - palette[index].red) + std::abs(g - palette[index].green) + std::abs(b - palette[index].blue));
+    }
+
+    stats.quantizer = quantizer == QUANTIZER_NeuQuant ? "NeuQuant" : "MedianCut";
+    stats.colors = palette.size();
+    stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    stats.error = error / (3.0 * totalArea);
+    return stats;
+}
+
+// Part of the GIF animation: the tree down to `level`, over one rectangle
+// (in GIF pixels).
+struct GifFrame
+{
+    int level;
+    int x, y, w, h;
+};
+
+// Maps image coordinates to the (possibly smaller) GIF canvas. Block edges
+// are mapped, not pixels, so the scaled blocks still tile the canvas
+// exactly; blocks smaller than a GIF pixel vanish into their neighbours.
+struct GifScale
+{
+    int imageWidth, imageHeight;
+    int width, height;
+    int X(int x) const { return (int)((int64_t)x * width / imageWidth); }
+    int Y(int y) const { return (int)((int64_t)y * height / imageHeight); }
+};
+
+// Paints what changes in `frame` within `node`'s subtree, clipped to the
+// frame's rectangle: the blocks at the frame's level whose palette index
+// differs from their parent's. `pixels` holds just that rectangle, filled
+// with GIF_TRANSPARENT.
+static void PaintGifFrame(QuadTreeNode *node, int level, int parentIndex, const GifFrame &frame, const GifScale &scale, uint8_t *pixels, const std::unordered_map<uint32_t, uint8_t> &nearest) {
+    if (!node) {
+        return;
+    }
+    int left = std::max(scale.X(node->x), frame.x), right = std::min(scale.X(node->x + node->width), frame.x + frame.w);
+    int top = std::max(scale.Y(node->y), frame.y), bottom = std::min(scale.Y(node->y + node->height), frame.y + frame.h);
+    if (left >= right || top >= bottom) {
+        return;
+    }
+
+    uint32_t key = (uint32_t)node->color.r | ((uint32_t)node->color.g << 8) | ((uint32_t)node->color.b << 16);
+    uint8_t index = nearest.find(key)->second;
+    if (level == frame.level) {
+        if (index == parentIndex) {
+            return;
+        }
+        for (int y = top; y < bottom; y++) {
+            memset(pixels + (size_t)(y - frame.y) * frame.w + (left - frame.x), index, right - left);
+        }
+        return;
+    }
+    if (node->isLeaf) {
+        return;
+    }
+    for (int k = 0; k < 4; k++) {
+        PaintGifFrame(node->Child(k).get(), level + 1, index, frame, scale, pixels, nearest);
+    }
+}
+
+// The GIF is drawn from the tree alone, so it can be any size: with maxSize
+// > 0 its longer side is scaled down to at most maxSize pixels (it is never
+// scaled up). GIF sides can't exceed 65535 pixels, so larger images are
+// always scaled. With gifFd >= 0 the GIF is written to that descriptor
+// (which is closed afterwards) and gifOutputPath only names it in messages.
+// Messages go to stdout when `show` is set, and to stderr otherwise.
+void SaveGif(const std::string &gifOutputPath, std::unique_ptr<QuadTreeNode> &root, int imageWidth, int imageHeight, int quantizer, int maxSize, int gifFd = -1, bool show = true) {
+    const int gifMaxSide = 65535;
+    int longerSide = std::max(imageWidth, imageHeight);
+    int targetSide = std::min(maxSize > 0 ? maxSize : longerSide, gifMaxSide);
+    GifScale scale = {imageWidth, imageHeight, imageWidth, imageHeight};
+    if (longerSide > targetSide) {
+        scale.width = std::max(1, (int)((int64_t)imageWidth * targetSide / longerSide));
+        scale.height = std::max(1, (int)((int64_t)imageHeight * targetSide / longerSide));
     }
-    
-    NeuQuant* neuquant = new NeuQuant(256);
-    Quantizer* quantizer = neuquant;
-    Palette palette;
 
     uint8_t gifPalette[256 * 3];
     memset(gifPalette, 0, sizeof(gifPalette));
-
-    if((int)image.size() > 256) {
-        quantizer->AddPixels(rgbData.data(), image.size());
-        Palette palette = quantizer->GetPalette();
-        for (size_t i = 0; i < std::min(palette.size(), size_t(256)); ++i) {
-            gifPalette[i * 3 + 0] = palette[i].red;
-            gifPalette[i * 3 + 1] = palette[i].green;
-            gifPalette[i * 3 + 2] = palette[i].blue;
+    std::unordered_map<uint32_t, uint8_t> nearest;
+    std::unordered_map<uint32_t, uint64_t> areas = GifColorAreas(root.get());
+    std::vector<int> options = {quantizer};
+    if (quantizer == GIF_COMPARE_QUANTIZERS) {
+        options = {QUANTIZER_MedianCut, QUANTIZER_NeuQuant};
+        if (areas.size() <= GIF_COLORS) {
+            options.insert(options.begin(), -1);
+        } else {
+            (show ? std::cout : std::cerr) << "Palet GIF: exact tidak mungkin, " << areas.size() << " warna" << std::endl;
         }
     }
-    else {
-        for (size_t i = 0; i < image.size(); ++i) {
-            gifPalette[i * 3 + 0] = image[i].r;
-            gifPalette[i * 3 + 1] = image[i].g;
-            gifPalette[i * 3 + 2] = image[i].b;
+    double bestError = 0;
+    for (size_t i = 0; i < options.size(); i++) {
+        uint8_t optionPalette[256 * 3];
+        memset(optionPalette, 0, sizeof(optionPalette));
+        std::unordered_map<uint32_t, uint8_t> optionNearest;
+        GifPaletteStats stats = BuildGifPalette(areas, options[i], options.size() > 1, optionPalette, optionNearest);
+
+        std::ostringstream report;
+        report << "Palet GIF: " << stats.quantizer << ", " << stats.colors << " warna, "
+               << std::fixed << std::setprecision(1) << stats.milliseconds << " ms, error rata-rata "
+               << std::setprecision(3) << stats.error;
+        (show ? std::cout : std::cerr) << report.str() << std::endl;
+        if (i == 0 || stats.error < bestError) {
+            bestError = stats.error;
+            memcpy(gifPalette, optionPalette, sizeof(gifPalette));
+            nearest.swap(optionNearest);
         }
     }
-    
-    ge_GIF* gif = ge_new_gif(gifOutputPath.c_str(), imageWidth, imageHeight, gifPalette, 8, 0, 0);
+
+    ge_GIF* gif = gifFd >= 0 ? ge_new_gif_fd(gifFd, scale.width, scale.height, gifPalette, 8, 0, 0)
+                             : ge_new_gif(gifOutputPath.c_str(), scale.width, scale.height, gifPalette, 8, 0, 0);
 
     if (!gif) {
         std::cerr << "Failed to create GIF." << std::endl;
-        delete quantizer;
         return;
     }
     
-    std::vector<QuadTreeNode*> nodes, newNodes;
-    nodes.push_back(root.get());
-    
-    int counter = 0;
-    bool cont = true;
-    
-    while (cont && !nodes.empty()) {
-        cont = false;
-        std::vector<uint8_t> frameRGB(imageWidth * imageHeight * 3);
-        std::vector<uint8_t> frameIndexed(imageWidth * imageHeight);
-
-        for (QuadTreeNode* node : nodes) {
-            if (!node) continue;
-            
-            for (int i = 0; i < node->height; i++) {
-                for (int j = 0; j < node->width; j++) {
-                    int xx = node->x + j, yy = node->y + i;
-                    int idx = yy * imageWidth + xx;
-                    
-                    frameRGB[idx * 3 + 0] = node->color.r;
-                    frameRGB[idx * 3 + 1] = node->color.g;
-                    frameRGB[idx * 3 + 2] = node->color.b;
-                    
-                    ColorRegister pixel = {node->color.r, node->color.g, node->color.b};
-                    frameIndexed[idx] = neuquant->lookup(pixel);
-                }
+    // Frame 0 shows the root over the whole image. Frame k shows the tree
+    // down to level k, but only over the bounding box of the blocks split at
+    // level k - 1, and only the pixels that change: the rest of the box is
+    // transparent so the previous frame shows through and LZW sees long runs.
+    std::vector<GifFrame> frames = {{0, 0, 0, scale.width, scale.height}};
+    std::vector<QuadTreeNode*> split, nextSplit;
+    if (root && !root->isLeaf) split.push_back(root.get());
+    for (int level = 1; !split.empty(); level++) {
+        int left = scale.width, top = scale.height, right = 0, bottom = 0;
+        for (QuadTreeNode *node : split) {
+            for (int k = 0; k < 4; k++) {
+                QuadTreeNode *child = node->Child(k).get();
+                if (child && !child->isLeaf) nextSplit.push_back(child);
             }
-            
+            left = std::min(left, scale.X(node->x));
+            top = std::min(top, scale.Y(node->y));
+            right = std::max(right, scale.X(node->x + node->width));
+            bottom = std::max(bottom, scale.Y(node->y + node->height));
+        }
+        // Splits too small to see still get a (transparent) frame.
+        left = std::min(left, scale.width - 1);
+        top = std::min(top, scale.height - 1);
+        frames.push_back({level, left, top, std::max(right - left, 1), std::max(bottom - top, 1)});
+        split.swap(nextSplit);
+        nextSplit.clear();
+    }
 
-            if (node->isLeaf) {
-                newNodes.push_back(node);
+    // Frames are independent once their rectangles are known, so workers
+    // take them in turn, paint and LZW-encode each into its own buffer, and
+    // this thread appends the buffers to the GIF in frame order. With more
+    // than one thread, large frames are also cut into row bands that are
+    // LZW-coded separately; whichever worker finishes a frame's last band
+    // joins them.
+    const int64_t minBandPixels = 1 << 18;
+    int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+    struct GifTask
+    {
+        size_t frame;
+        int band;
+        int row, rows;
+    };
+    std::vector<GifTask> tasks;
+    std::vector<std::vector<ge_Band*>> bands(frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+        int64_t pixelCount = (int64_t)frames[i].w * frames[i].h;
+        int bandCount = (int)std::min<int64_t>({threads, pixelCount / minBandPixels, frames[i].h});
+        bandCount = std::max(bandCount, 1);
+        bands[i].assign(bandCount, nullptr);
+        for (int b = 0; b < bandCount; b++) {
+            int row = (int)((int64_t)frames[i].h * b / bandCount);
+            int end = (int)((int64_t)frames[i].h * (b + 1) / bandCount);
+            tasks.push_back({i, b, row, end - row});
+        }
+    }
+
+    std::vector<uint8_t*> encoded(frames.size(), nullptr);
+    std::vector<size_t> encodedSizes(frames.size(), 0);
+    std::vector<int> bandsLeft(frames.size());
+    std::vector<bool> finished(frames.size(), false);
+    for (size_t i = 0; i < frames.size(); i++) {
+        bandsLeft[i] = (int)bands[i].size();
+    }
+    std::mutex mutex;
+    std::condition_variable frameReady;
+    std::atomic<size_t> nextTask(0);
+
+    auto encodeFrames = [&]() {
+        std::vector<uint8_t> pixels;
+        for (size_t t; (t = nextTask++) < tasks.size();) {
+            const GifTask &task = tasks[t];
+            const GifFrame &frame = frames[task.frame];
+            int transparent = task.frame == 0 ? -1 : GIF_TRANSPARENT;
+            GifFrame band = {frame.level, frame.x, frame.y + task.row, frame.w, task.rows};
+            pixels.assign((size_t)band.w * band.h, task.frame == 0 ? 0 : GIF_TRANSPARENT);
+            PaintGifFrame(root.get(), 0, -1, band, scale, pixels.data(), nearest);
+
+            uint8_t *data = nullptr;
+            size_t size = 0;
+            std::vector<ge_Band*> &frameBands = bands[task.frame];
+            if (frameBands.size() == 1) {
+                data = ge_encode_frame_rect(gif, 100, frame.x, frame.y, frame.w, frame.h, transparent, pixels.data(), &size);
             }
             else {
-                cont = true;
-                newNodes.push_back(node->atasKiri.get());
-                newNodes.push_back(node->atasKanan.get());
-                newNodes.push_back(node->bawahKiri.get());
-                newNodes.push_back(node->bawahKanan.get());
+                ge_Band *coded = ge_encode_band(gif, pixels.data(), band.w, band.h);
+                bool last;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    frameBands[task.band] = coded;
+                    last = --bandsLeft[task.frame] == 0;
+                }
+                if (!last) {
+                    continue;
+                }
+                if (std::find(frameBands.begin(), frameBands.end(), nullptr) == frameBands.end()) {
+                    data = ge_encode_frame_bands(gif, 100, frame.x, frame.y, frame.w, frame.h, transparent,
+                                                 frameBands.data(), (int)frameBands.size(), &size);
+                }
+                for (ge_Band *coded : frameBands) {
+                    ge_free_band(coded);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                encoded[task.frame] = data;
+                encodedSizes[task.frame] = size;
+                finished[task.frame] = true;
             }
+            frameReady.notify_one();
         }
-        
-        memcpy(gif->frame, frameIndexed.data(), imageWidth * imageHeight);
-        
-        ge_add_frame(gif, 100);
+    };
 
-        nodes.swap(newNodes);
-        std::vector<QuadTreeNode*>().swap(newNodes);
+    threads = std::min(threads, (int)tasks.size());
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back(encodeFrames);
     }
-    
-    std::vector<QuadTreeNode*>().swap(nodes);
-    std::vector<QuadTreeNode*>().swap(newNodes);
-    delete quantizer;
-    
-    if (gif) {
+
+    bool encodeFailed = false;
+    for (size_t i = 0; i < frames.size(); i++) {
+        std::unique_lock<std::mutex> lock(mutex);
+        frameReady.wait(lock, [&] { return finished[i]; });
+        lock.unlock();
+        if (!encoded[i]) {
+            encodeFailed = true;
+            continue;
+        }
+        ge_add_encoded_frame(gif, encoded[i], encodedSizes[i]);
+        free(encoded[i]);
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    if (encodeFailed) {
         ge_close_gif(gif);
+        std::cerr << "GIF tidak berhasil disimpan di " << gifOutputPath << std::endl;
+        return;
+    }
+    if (ge_close_gif(gif) != 0) {
+        std::cerr << "GIF tidak berhasil disimpan di " << gifOutputPath << std::endl;
+    }
+    else if (show) {
         std::cout << "GIF berhasil disimpan di " << gifOutputPath << std::endl;
     }
 }
 
-int main() {
+// Maps the -q / interactive palette choice to SaveGif's `quantizer`.
+static int GifQuantizerChoice(int choice) {
+    switch (choice)
+    {
+    case 1: return QUANTIZER_MedianCut;
+    case 2: return QUANTIZER_NeuQuant;
+    case 3: return GIF_COMPARE_QUANTIZERS;
+    default: return -1;
+    }
+}
+
+static void PrintUsage() {
+    std::cerr << "Penggunaan: runner [opsi]\n"
+                 "Tanpa opsi, program berjalan secara interaktif.\n"
+                 "\n"
+                 "  -i <file>      gambar input, '-' untuk stdin (default: -)\n"
+                 "  -o <file>      hasil kompresi, '-' untuk stdout (default: -)\n"
+                 "  -f <format>    png, jpg, qtc, qtz, qtp atau qti (default: ekstensi dari -o)\n"
+                 "  -m <1-5>       metode error: 1 variansi, 2 MAD, 3 selisih piksel maksimum,\n"
+                 "                 4 entropi, 5 SSIM\n"
+                 "  -t <nilai>     threshold\n"
+                 "  -b <ukuran>    ukuran blok minimum (default: 1)\n"
+                 "  -r <rasio>     target rasio kompresi 0.0-1.0, menggantikan -t (default: 0)\n"
+                 "  -p <0-2>       palet 8-bit untuk png: 0 tidak, 1 MedianCut, 2 NeuQuant\n"
+                 "  -q <0-3>       palet GIF: 0 tepat (MedianCut jika lebih dari 255 warna),\n"
+                 "                 1 MedianCut, 2 NeuQuant, 3 bandingkan semua dan pakai\n"
+                 "                 yang error-nya terkecil (default: 2)\n"
+                 "  --gif <file>   simpan GIF proses ke file\n"
+                 "  --gif-size <n> sisi terpanjang GIF dalam piksel, 0 untuk ukuran asli (default: 0)\n"
+                 "  --gif-fd <fd>  tulis GIF proses ke file descriptor yang sudah terbuka\n";
+}
+
+// Non-interactive mode for shell pipelines: parameters come from flags, the
+// image is read from stdin (or -i) and the result written to stdout (or -o).
+// Statistics go to stderr so they never mix with the output.
+static int RunWithFlags(int argc, char **argv) {
+    std::string inputPath = "-", outputPath = "-", format, gifPath;
+    int gifFd = -1;
+    int errorMeasurementChoice = 0;
+    double threshold = 0;
+    bool hasThreshold = false;
+    int minBlockSize = 1;
+    double targetCompressionRatio = 0.0;
+    int paletteChoice = 0;
+    int gifChoice = 2;
+    int gifSize = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        if (flag == "-h" || flag == "--help") {
+            PrintUsage();
+            return 0;
+        }
+        // Unknown flags are reported before looking for a value, so a typo
+        // never swallows the flag after it.
+        static const char *const knownFlags[] = {"-i", "-o", "-f", "-m", "-t", "-b", "-r", "-p", "-q", "--gif", "--gif-fd", "--gif-size"};
+        if (std::find(std::begin(knownFlags), std::end(knownFlags), flag) == std::end(knownFlags)) {
+            std::cerr << "Opsi tidak dikenal: " << flag << std::endl;
+            PrintUsage();
+            return 2;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Opsi " << flag << " membutuhkan nilai" << std::endl;
+            PrintUsage();
+            return 2;
+        }
+        std::string value = argv[++i];
+
+        try {
+            if (flag == "-i") inputPath = value;
+            else if (flag == "-o") outputPath = value;
+            else if (flag == "-f") format = value;
+            else if (flag == "-m") errorMeasurementChoice = std::stoi(value);
+            else if (flag == "-t") { threshold = std::stod(value); hasThreshold = true; }
+            else if (flag == "-b") minBlockSize = std::stoi(value);
+            else if (flag == "-r") targetCompressionRatio = std::stod(value);
+            else if (flag == "-p") paletteChoice = std::stoi(value);
+            else if (flag == "-q") gifChoice = std::stoi(value);
+            else if (flag == "--gif") gifPath = value;
+            else if (flag == "--gif-fd") gifFd = std::stoi(value);
+            else if (flag == "--gif-size") gifSize = std::stoi(value);
+        }
+        catch (const std::exception &) {
+            std::cerr << "Nilai tidak valid untuk " << flag << ": " << value << std::endl;
+            return 2;
+        }
+    }
+
+    if (format.empty()) {
+        if (outputPath == "-") {
+            std::cerr << "Format hasil harus diberikan dengan -f jika menulis ke stdout" << std::endl;
+            return 2;
+        }
+        format = outputPath;
+    }
+    format = GetExtension(format);
+    if (!IsOutputExtension(format)) {
+        std::cerr << "Format hasil tidak didukung: " << format << std::endl;
+        return 2;
+    }
+    if (errorMeasurementChoice < 1 || errorMeasurementChoice > 5) {
+        std::cerr << "Metode error harus antara 1-5 (-m)" << std::endl;
+        return 2;
+    }
+    double low, high;
+    ThresholdRange(errorMeasurementChoice, low, high);
+    if (targetCompressionRatio == 0.0 && (!hasThreshold || threshold < low || threshold > high)) {
+        std::cerr << "Threshold harus antara " << low << " dan " << high << " (-t)" << std::endl;
+        return 2;
+    }
+    if (minBlockSize < 1) {
+        std::cerr << "Ukuran blok minimum harus lebih besar dari 0 (-b)" << std::endl;
+        return 2;
+    }
+    if (targetCompressionRatio < 0.0 || targetCompressionRatio > 1.0) {
+        std::cerr << "Rasio kompresi harus antara 0.0 dan 1.0 (-r)" << std::endl;
+        return 2;
+    }
+    if (paletteChoice < 0 || paletteChoice > 2) {
+        std::cerr << "Pilihan palet harus antara 0-2 (-p)" << std::endl;
+        return 2;
+    }
+    if (gifChoice < 0 || gifChoice > 3) {
+        std::cerr << "Pilihan palet GIF harus antara 0-3 (-q)" << std::endl;
+        return 2;
+    }
+    if (gifSize < 0) {
+        std::cerr << "Ukuran GIF tidak boleh negatif (--gif-size)" << std::endl;
+        return 2;
+    }
+    int leafPalette = -1;
+    if (format == "png" && paletteChoice == 1) leafPalette = QUANTIZER_MedianCut;
+    if (format == "png" && paletteChoice == 2) leafPalette = QUANTIZER_NeuQuant;
+    int gifQuantizer = GifQuantizerChoice(gifChoice);
+
+    try {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        int width, height;
+        uint64_t originalSize = 0;
+        ImageBuffer image = LoadImage(inputPath, width, height, &originalSize);
+
+        ImageBuffer outputImage;
+        outputImage.Resize(width, height);
+
+        std::unique_ptr<QuadTreeNode> root;
+        if (targetCompressionRatio == 0.0) {
+            root = BuildQuadTree(image, 0, 0, width, height, threshold, minBlockSize, errorMeasurementChoice);
+        }
+        else {
+            root = SearchThreshold(image, outputImage, format, leafPalette, originalSize,
+                                   targetCompressionRatio * 100.0, low, high, errorMeasurementChoice);
+        }
+        reconstructImage(outputImage, root);
+
+        bool success;
+        double compressedSize;
+        if (outputPath == "-") {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            std::ostringstream encoded;
+            success = WriteImage(encoded, format, outputImage, root, width, height, leafPalette);
+            std::string bytes = encoded.str();
+            success = success && std::cout.write(bytes.data(), bytes.size()).flush();
+            compressedSize = bytes.size();
+        }
+        else {
+            std::ofstream file(outputPath, std::ios::binary);
+            success = file && WriteImage(file, format, outputImage, root, width, height, leafPalette);
+            compressedSize = success ? (double)file.tellp() : 0;
+        }
+        if (!success) {
+            std::cerr << "Gambar tidak berhasil disimpan" << std::endl;
+            return 1;
+        }
+
+        if (gifFd >= 0 || !gifPath.empty()) {
+            std::string gifName = gifFd >= 0 ? "fd " + std::to_string(gifFd) : gifPath;
+            SaveGif(gifName, root, width, height, gifQuantizer, gifSize, gifFd, false);
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+        std::cerr << "Waktu pemrosesan: " << duration << " ms" << std::endl;
+        std::cerr << "Ukuran Sebelum Kompresi: " << originalSize << " bytes" << std::endl;
+        std::cerr << "Ukuran Setelah Kompresi: " << compressedSize << " bytes" << std::endl;
+        std::cerr << std::fixed << std::setprecision(6) << "Rasio Kompresi: " << (1 - compressedSize / originalSize) * 100.0 << "%" << std::endl;
+        std::cerr << "Kedalaman Maksimum: " << GetMaxDepth(root) << std::endl;
+        std::cerr << "Banyak Simpul: " << GetNodeCount(root) << std::endl;
+    }
+    catch (const ImageLoadException &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    catch (const std::bad_alloc &) {
+        std::cerr << "Error: Not enough memory" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        return RunWithFlags(argc, argv);
+    }
+
     try {
         int width, height;
 
@@ -335,6 +895,7 @@ int main() {
         double threshold;
         int minBlockSize;
         double targetCompressionRatio;
+        int leafPalette = -1;
         double low, high;
 
         std::cout << "Masukkan alamat absolut ke gambar input (contoh: test/a.jpg): ";
@@ -346,6 +907,7 @@ int main() {
             std::cout << "Masukkan alamat absolut ke gambar input (contoh: test/a.jpg): ";
             std::getline(std::cin, originalImagePath);
         }
+        uint64_t originalSize = (uint64_t)buffer.st_size;
 
         std::cout << "Pilih metode perhitungan error:\n";
         std::cout << "1. Variansi\n";
@@ -361,31 +923,7 @@ int main() {
             std::cin >> errorMeasurementChoice;
         }
 
-        switch (errorMeasurementChoice)
-        {
-        case 1:
-            // Variance
-            low = 0; high = 16256.25;
-            break;
-        case 2:
-            // Mean Absolute Deviation (MAD)
-            low = 0; high = 127.5;
-            break;
-        case 3:
-            // Max Pixel Difference
-            low = 0; high = 255;
-            break;
-
-        case 4:
-            // Entropy (rentang 0-8)
-            low = 0; high = 8;
-            break;
-
-        case 5:
-            // SSIM (rentang 0-1)
-            low = -1; high = 1;
-            break;
-        }
+        ThresholdRange(errorMeasurementChoice, low, high);
 
         std::cout << "Masukkan nilai threshold: ";
         std::cin >> threshold;
@@ -416,68 +954,118 @@ int main() {
         std::cout << "Masukkan alamat absolut untuk menyimpan gambar hasil kompresi (contoh: test/b.png): ";
         std::getline(std::cin, compressedImagePath);
 
+        if (GetExtension(compressedImagePath) == "png") {
+            int paletteChoice;
+            std::cout << "Kuantisasi warna blok ke palet 8-bit (0 = tidak, 1 = MedianCut, 2 = NeuQuant): ";
+            std::cin >> paletteChoice;
+
+            while (paletteChoice < 0 || paletteChoice > 2) {
+                std::cout << "Pilihan tidak valid. Silakan pilih antara 0-2: ";
+                std::cin >> paletteChoice;
+            }
+            std::cin.ignore();
+
+            if (paletteChoice == 1) leafPalette = QUANTIZER_MedianCut;
+            if (paletteChoice == 2) leafPalette = QUANTIZER_NeuQuant;
+        }
+
         std::cout << "Masukkan alamat absolut untuk menyimpan GIF (contoh: test/process.gif): ";
         std::getline(std::cin, gifOutputPath);
 
+        int gifChoice;
+        std::cout << "Kuantisasi palet GIF (0 = tepat, MedianCut jika lebih dari 255 warna; 1 = MedianCut; 2 = NeuQuant; 3 = bandingkan semua): ";
+        std::cin >> gifChoice;
+
+        while (gifChoice < 0 || gifChoice > 3) {
+            std::cout << "Pilihan tidak valid. Silakan pilih antara 0-3: ";
+            std::cin >> gifChoice;
+        }
+        std::cin.ignore();
+        int gifQuantizer = GifQuantizerChoice(gifChoice);
+
+        int gifSize;
+        std::cout << "Masukkan sisi terpanjang GIF dalam piksel (0 untuk ukuran asli): ";
+        std::cin >> gifSize;
+
+        while (gifSize < 0) {
+            std::cout << "Ukuran tidak valid. Silakan masukkan nilai 0 atau lebih: ";
+            std::cin >> gifSize;
+        }
+        std::cin.ignore();
+
         std::cout << "Memproses gambar..." << std::endl;
 
         auto startTime = std::chrono::high_resolution_clock::now();
 
-        std::unique_ptr<QuadTreeNode> root;
-        std::vector<RGBPixel> image = LoadImage(originalImagePath, width, height);
+        // Inputs whose decoded pixels would not fit comfortably in memory are
+        // compressed tile by tile straight into a .qtc file.
+        const uint64_t tiledMinBytes = 1ull << 30;
+        const size_t tiledBandBytes = 256u << 20;
+        std::unique_ptr<RowSource> source = OpenRowSource(originalImagePath);
+        if (source && targetCompressionRatio == 0.0 && GetExtension(compressedImagePath) == "qtc" &&
+            (uint64_t)source->Width() * source->Height() * 3 >= tiledMinBytes) {
+            std::cout << "Gambar besar, diproses per tile tanpa memuat seluruh gambar. GIF tidak dibuat." << std::endl;
+
+            SubtreeBuilder build = [&](const ImageBuffer &band, int x, int y, int w, int h) {
+                return BuildQuadTree(band, x, y, w, h, threshold, minBlockSize, errorMeasurementChoice);
+            };
+            TiledStats stats;
+            if (CompressTiled(*source, compressedImagePath, build, tiledBandBytes, stats)) {
+                std::cout << "Gambar berhasil disimpan di " << compressedImagePath << std::endl;
+            } else {
+                std::cerr << "Gambar tidak berhasil disimpan" << std::endl;
+            }
 
-        std::vector<RGBPixel> outputImage(width * height);
+            auto endTime = std::chrono::high_resolution_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+            std::cout << "Waktu pemrosesan: " << duration << " ms" << std::endl;
 
-        if (targetCompressionRatio == 0.0) {
-            root = BuildQuadTree(image, 0, 0, width, height, threshold, minBlockSize, errorMeasurementChoice, width);
+            double compressionRatio = CalculateCompressionRatio(originalSize, compressedImagePath, 1);
+            std::cout << std::fixed << std::setprecision(6) << "Rasio Kompresi: " << compressionRatio << "%" << std::endl;
+            std::cout << "Kedalaman Maksimum: " << stats.maxDepth << std::endl;
+            std::cout << "Banyak Simpul: " << stats.nodeCount << std::endl;
+            return 0;
         }
-        else {
-            // Mengasumsikan rasio bergantung sepenuhnya pada threshold
-            
-            targetCompressionRatio *= 100.0;
-
-            int tempBlockSize = 1;
-            long double L = low, R = high;
+        source.reset();
 
-            for (int _ = 0; _ < 20; _++) {
-                long double M = (L + R) / 2.0;
+        std::unique_ptr<QuadTreeNode> root;
+        ImageBuffer image = LoadImage(originalImagePath, width, height, &originalSize);
 
-                root = BuildQuadTree(image, 0, 0, width, height, M, tempBlockSize, errorMeasurementChoice, width);
+        ImageBuffer outputImage;
+        outputImage.Resize(width, height);
 
-                outputImage = std::vector<RGBPixel>(width * height);
-                reconstructImage(outputImage, root, width);
-                SaveImage(compressedImagePath, outputImage, width, height, false);
-                double compressionRatio = CalculateCompressionRatio(originalImagePath, compressedImagePath, false);
-                if (compressionRatio < targetCompressionRatio) {
-                    L = M;
-                }
-                else {
-                    R = M;
-                }
-            }
+        if (targetCompressionRatio == 0.0) {
+            root = BuildQuadTree(image, 0, 0, width, height, threshold, minBlockSize, errorMeasurementChoice);
+        }
+        else {
+            root = SearchThreshold(image, outputImage, GetExtension(compressedImagePath), leafPalette, originalSize,
+                                   targetCompressionRatio * 100.0, low, high, errorMeasurementChoice);
         }
 
-        reconstructImage(outputImage, root, width);
+        reconstructImage(outputImage, root);
 
-        SaveImage(compressedImagePath, outputImage, width, height, true);
-        SaveGif(gifOutputPath, image, root, width, height);
+        SaveImage(compressedImagePath, outputImage, root, width, height, leafPalette, true);
+        SaveGif(gifOutputPath, root, width, height, gifQuantizer, gifSize);
         
         auto endTime = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
         std::cout << "Waktu pemrosesan: " << duration << " ms" << std::endl;
 
-        double compressionRatio = CalculateCompressionRatio(originalImagePath, compressedImagePath, 1);
+        double compressionRatio = CalculateCompressionRatio(originalSize, compressedImagePath, 1);
         std::cout << std::fixed << std::setprecision(6) << "Rasio Kompresi: " << compressionRatio << "%" << std::endl;
         
         int maxDepth = GetMaxDepth(root);
         std::cout << "Kedalaman Maksimum: " << maxDepth << std::endl;
         
-        int nodeCount = GetNodeCount(root);
+        uint64_t nodeCount = GetNodeCount(root);
         std::cout << "Banyak Simpul: " << nodeCount << std::endl;
     }
     catch (const ImageLoadException &e) {
         std::cerr << "Error: " << e.what() << std::endl;
     }
+    catch (const std::bad_alloc &) {
+        std::cerr << "Error: Not enough memory" << std::endl;
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include "Inflate.hpp"
+#include "ImageLoadException.hpp"
+
+#include <cstring>
+
+static const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static const size_t INPUT_BUFFER_SIZE = 1 << 16;
+
+void Inflater::Huffman::Build(const uint8_t *lengths, int symbolCount) {
+    memset(fast, 0, sizeof(fast));
+    memset(count, 0, sizeof(count));
+    for (int i = 0; i < symbolCount; i++) {
+        count[lengths[i]]++;
+    }
+    count[0] = 0;
+
+    int nextCode[MAX_BITS + 1];
+    int code = 0, index = 0;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        code = (code + count[len - 1]) << 1;
+        if (code + count[len] > (1 << len)) {
+            throw ImageLoadException("Corrupt deflate stream (over-subscribed code)");
+        }
+        firstCode[len] = (uint16_t)code;
+        firstIndex[len] = (uint16_t)index;
+        nextCode[len] = code;
+        index += count[len];
+    }
+
+    for (int symbol = 0; symbol < symbolCount; symbol++) {
+        int len = lengths[symbol];
+        if (len == 0) continue;
+        int c = nextCode[len]++;
+        symbols[firstIndex[len] + c - firstCode[len]] = (uint16_t)symbol;
+        if (len > LOOKUP_BITS) continue;
+
+        int reversed = 0;
+        for (int b = 0; b < len; b++) {
+            reversed = (reversed << 1) | ((c >> b) & 1);
+        }
+        for (int k = reversed; k < (1 << LOOKUP_BITS); k += 1 << len) {
+            fast[k] = (uint16_t)(symbol << 4 | len);
+        }
+    }
+}
+
+Inflater::Inflater(InputFunction input) : input(std::move(input)), buffer(INPUT_BUFFER_SIZE), window(WINDOW_SIZE) {}
+
+bool Inflater::Refill() {
+    if (inputEnded) {
+        return false;
+    }
+    bufferPos = 0;
+    bufferEnd = input(buffer.data(), buffer.size());
+    if (bufferEnd == 0) {
+        inputEnded = true;
+        return false;
+    }
+    return true;
+}
+
+void Inflater::Need(int count) {
+    while (bitCount < count) {
+        if (bufferPos == bufferEnd && !Refill()) {
+            throw ImageLoadException("Deflate stream truncated");
+        }
+        // Top up with whole bytes, eight at a time when the buffer allows.
+        if (bufferEnd - bufferPos >= 8) {
+            uint64_t next;
+            memcpy(&next, &buffer[bufferPos], 8);
+            bits |= next << bitCount;
+            bufferPos += (63 - bitCount) >> 3;
+            bitCount |= 56;
+            continue;
+        }
+        bits |= (uint64_t)buffer[bufferPos++] << bitCount;
+        bitCount += 8;
+    }
+}
+
+uint32_t Inflater::GetBits(int count) {
+    Need(count);
+    uint32_t value = (uint32_t)(bits & ((1ull << count) - 1));
+    bits >>= count;
+    bitCount -= count;
+    return value;
+}
+
+int Inflater::Decode(const Huffman &code) {
+    if (bitCount < MAX_BITS) {
+        // The last code of the stream may be followed by fewer than MAX_BITS
+        // bits.
+        if (bufferEnd - bufferPos >= 8) {
+            Need(MAX_BITS);
+        }
+        while (bitCount < MAX_BITS && (bufferPos < bufferEnd || Refill())) {
+            bits |= (uint64_t)buffer[bufferPos++] << bitCount;
+            bitCount += 8;
+        }
+    }
+
+    uint16_t entry = code.fast[bits & ((1 << LOOKUP_BITS) - 1)];
+    int len = entry & 15;
+    int symbol = entry >> 4;
+    if (len == 0) {
+        // Longer code: extend it bit by bit until it falls in the range of
+        // codes of its length.
+        int c = 0;
+        for (len = 1; len <= MAX_BITS; len++) {
+            c = (c << 1) | (int)((bits >> (len - 1)) & 1);
+            if ((unsigned)(c - code.firstCode[len]) < code.count[len]) {
+                break;
+            }
+        }
+        if (len > MAX_BITS) {
+            throw ImageLoadException("Corrupt deflate stream (invalid code)");
+        }
+        symbol = code.symbols[code.firstIndex[len] + c - code.firstCode[len]];
+    }
+    if (len > bitCount) {
+        throw ImageLoadException("Deflate stream truncated");
+    }
+    bits >>= len;
+    bitCount -= len;
+    return symbol;
+}
+
+void Inflater::ReadDynamicTables() {
+    int literalCount = GetBits(5) + 257;
+    int distanceCount = GetBits(5) + 1;
+    int codeLengthCount = GetBits(4) + 4;
+
+    uint8_t codeLengthLengths[19] = {0};
+    for (int i = 0; i < codeLengthCount; i++) {
+        codeLengthLengths[CODE_LENGTH_ORDER[i]] = (uint8_t)GetBits(3);
+    }
+    Huffman codeLengths;
+    codeLengths.Build(codeLengthLengths, 19);
+
+    uint8_t lengths[286 + 30] = {0};
+    int total = literalCount + distanceCount;
+    int i = 0;
+    while (i < total) {
+        int symbol = Decode(codeLengths);
+        if (symbol < 16) {
+            lengths[i++] = (uint8_t)symbol;
+            continue;
+        }
+
+        uint8_t value = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (i == 0) {
+                throw ImageLoadException("Corrupt deflate stream (repeat without length)");
+            }
+            value = lengths[i - 1];
+            repeat = 3 + GetBits(2);
+        }
+        else if (symbol == 17) {
+            repeat = 3 + GetBits(3);
+        }
+        else {
+            repeat = 11 + GetBits(7);
+        }
+        if (i + repeat > total) {
+            throw ImageLoadException("Corrupt deflate stream (too many lengths)");
+        }
+        while (repeat-- > 0) {
+            lengths[i++] = value;
+        }
+    }
+    if (lengths[256] == 0) {
+        throw ImageLoadException("Corrupt deflate stream (no end-of-block code)");
+    }
+
+    literals.Build(lengths, literalCount);
+    distances.Build(lengths + literalCount, distanceCount);
+}
+
+void Inflater::ReadBlockHeader() {
+    lastBlock = GetBits(1) != 0;
+    int type = GetBits(2);
+
+    switch (type)
+    {
+    case 0:
+    {
+        GetBits(bitCount % 8);
+        uint32_t len = GetBits(16);
+        uint32_t nlen = GetBits(16);
+        if ((len ^ 0xFFFF) != nlen) {
+            throw ImageLoadException("Corrupt deflate stream (stored length)");
+        }
+        storedLeft = len;
+        state = STORED;
+        break;
+    }
+    case 1:
+    {
+        uint8_t lengths[288 + 30];
+        for (int i = 0; i < 288; i++) {
+            lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        }
+        for (int i = 0; i < 30; i++) {
+            lengths[288 + i] = 5;
+        }
+        literals.Build(lengths, 288);
+        distances.Build(lengths + 288, 30);
+        state = CODES;
+        break;
+    }
+    case 2:
+        ReadDynamicTables();
+        state = CODES;
+        break;
+    default:
+        throw ImageLoadException("Corrupt deflate stream (block type)");
+    }
+}
+
+void Inflater::Emit(uint8_t byte, uint8_t *dst, size_t &produced) {
+    window[windowPos & (WINDOW_SIZE - 1)] = byte;
+    windowPos++;
+    dst[produced++] = byte;
+}
+
+size_t Inflater::Read(uint8_t *dst, size_t size) {
+    size_t produced = 0;
+    while (produced < size) {
+        switch (state)
+        {
+        case HEADER:
+        {
+            uint32_t cmf = GetBits(8);
+            uint32_t flg = GetBits(8);
+            if ((cmf & 15) != 8 || (cmf * 256 + flg) % 31 != 0 || (flg & 0x20)) {
+                throw ImageLoadException("Unsupported zlib stream");
+            }
+            state = BLOCK_HEADER;
+            break;
+        }
+        case BLOCK_HEADER:
+            if (lastBlock) {
+                state = DONE;
+                break;
+            }
+            ReadBlockHeader();
+            break;
+        case STORED:
+            if (storedLeft == 0) {
+                state = BLOCK_HEADER;
+                break;
+            }
+            while (storedLeft > 0 && produced < size) {
+                Emit((uint8_t)GetBits(8), dst, produced);
+                storedLeft--;
+            }
+            break;
+        case CODES:
+        {
+            if (copyLeft > 0) {
+                while (copyLeft > 0 && produced < size) {
+                    Emit(window[(windowPos - copyDistance) & (WINDOW_SIZE - 1)], dst, produced);
+                    copyLeft--;
+                }
+                break;
+            }
+
+            int symbol = Decode(literals);
+            while (symbol < 256) {
+                Emit((uint8_t)symbol, dst, produced);
+                if (produced == size) {
+                    return produced;
+                }
+                symbol = Decode(literals);
+            }
+            if (symbol == 256) {
+                state = BLOCK_HEADER;
+                break;
+            }
+            symbol -= 257;
+            if (symbol >= 29) {
+                throw ImageLoadException("Corrupt deflate stream (length code)");
+            }
+            copyLeft = LENGTH_BASE[symbol] + GetBits(LENGTH_EXTRA[symbol]);
+
+            int distSymbol = Decode(distances);
+            if (distSymbol >= 30) {
+                throw ImageLoadException("Corrupt deflate stream (distance code)");
+            }
+            copyDistance = DIST_BASE[distSymbol] + GetBits(DIST_EXTRA[distSymbol]);
+            if (copyDistance > windowPos) {
+                throw ImageLoadException("Corrupt deflate stream (distance too far back)");
+            }
+            break;
+        }
+        case DONE:
+            return produced;
+        }
+    }
+    return produced;
+}
@@ -0,0 +1,75 @@
+#ifndef INFLATE_HPP
+#define INFLATE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Streaming zlib (RFC 1950/1951) decoder. Compressed bytes are pulled from
+// `input` as needed and decompressed bytes are handed out in whatever
+// amounts the caller asks for, so memory stays at the 32 KiB window plus
+// one input buffer no matter how large the stream is. Throws
+// ImageLoadException on corrupt or truncated data.
+class Inflater
+{
+public:
+    // Fills up to `size` bytes and returns how many were written, 0 once
+    // the input has ended.
+    using InputFunction = std::function<size_t(uint8_t *dst, size_t size)>;
+
+    explicit Inflater(InputFunction input);
+
+    // Returns the number of bytes written, less than `size` only at the end
+    // of the stream.
+    size_t Read(uint8_t *dst, size_t size);
+
+private:
+    static constexpr int MAX_BITS = 15;
+    static constexpr size_t WINDOW_SIZE = 1 << 15;
+
+    static constexpr int LOOKUP_BITS = 10;
+
+    // Codes up to LOOKUP_BITS long are looked up by the next LOOKUP_BITS bits
+    // (LSB first) as symbol << 4 | length, 0 marking a longer code. Those
+    // are decoded canonically, one bit at a time, from the per-length code
+    // ranges and the symbols sorted by code.
+    struct Huffman
+    {
+        uint16_t fast[1 << LOOKUP_BITS];
+        uint16_t count[MAX_BITS + 1];
+        uint16_t firstCode[MAX_BITS + 1];
+        uint16_t firstIndex[MAX_BITS + 1];
+        uint16_t symbols[288];
+        void Build(const uint8_t *lengths, int count);
+    };
+
+    enum State { HEADER, BLOCK_HEADER, STORED, CODES, DONE };
+
+    InputFunction input;
+    std::vector<uint8_t> buffer;
+    size_t bufferPos = 0, bufferEnd = 0;
+    bool inputEnded = false;
+
+    uint64_t bits = 0;
+    int bitCount = 0;
+
+    State state = HEADER;
+    bool lastBlock = false;
+    size_t storedLeft = 0;
+    Huffman literals, distances;
+
+    std::vector<uint8_t> window;
+    size_t windowPos = 0;
+    size_t copyLeft = 0, copyDistance = 0;
+
+    bool Refill();
+    void Need(int count);
+    uint32_t GetBits(int count);
+    int Decode(const Huffman &code);
+    void ReadBlockHeader();
+    void ReadDynamicTables();
+    void Emit(uint8_t byte, uint8_t *dst, size_t &produced);
+};
+
+#endif
@@ -0,0 +1,369 @@
+#include "JpegWriter.hpp"
+
+#include <algorithm>
+
+static const uint8_t ZIGZAG[64] = {
+    0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42,
+    3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18, 24, 31, 40, 44, 53,
+    10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60,
+    21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63};
+
+static const uint8_t Y_QUANT[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+
+static const uint8_t UV_QUANT[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+// AAN scale factors, sqrt(8) * cos(k * pi / 16) with the k = 0 term scaled
+// the same way.
+static const float AAN_SCALE[8] = {
+    1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
+    1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f};
+
+// Standard Huffman tables (ITU T.81 annex K): 16 code counts, then values.
+static const uint8_t DC_LUMA_COUNTS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t DC_CHROMA_COUNTS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t DC_VALUES[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t AC_LUMA_COUNTS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t AC_LUMA_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa};
+
+static const uint8_t AC_CHROMA_COUNTS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t AC_CHROMA_VALUES[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa};
+
+struct HuffmanCode
+{
+    uint16_t code;
+    uint8_t length;
+};
+
+struct HuffmanTable
+{
+    HuffmanCode symbols[256];
+
+    HuffmanTable(const uint8_t counts[16], const uint8_t *values) {
+        std::fill(symbols, symbols + 256, HuffmanCode{0, 0});
+        int code = 0, k = 0;
+        for (int len = 1; len <= 16; len++) {
+            for (int i = 0; i < counts[len - 1]; i++) {
+                symbols[values[k++]] = {(uint16_t)code++, (uint8_t)len};
+            }
+            code <<= 1;
+        }
+    }
+};
+
+// One component of the scan: its quantizer, Huffman tables and the DC of
+// the previous block.
+struct JpegComponent
+{
+    const HuffmanTable &dc;
+    const HuffmanTable &ac;
+    float divisors[64];
+    int previousDC = 0;
+};
+
+class JpegBitWriter
+{
+public:
+    std::vector<uint8_t> bytes;
+
+    void Put(uint32_t bits, int count) {
+        buffer = (buffer << count) | (bits & ((1u << count) - 1));
+        filled += count;
+        while (filled >= 8) {
+            uint8_t c = (uint8_t)(buffer >> (filled - 8));
+            bytes.push_back(c);
+            if (c == 0xFF) {
+                bytes.push_back(0);
+            }
+            filled -= 8;
+        }
+    }
+
+    void Put(const HuffmanCode &c) { Put(c.code, c.length); }
+
+    // Pads the last byte with ones.
+    void Flush() {
+        if (filled > 0) {
+            Put(0x7F, 8 - filled);
+        }
+    }
+
+private:
+    uint64_t buffer = 0;
+    int filled = 0;
+};
+
+// Magnitude category of a coefficient and its extra bits.
+static int Category(int value, uint32_t &bits) {
+    int magnitude = value < 0 ? -value : value;
+    int category = 0;
+    while (magnitude >> category) {
+        category++;
+    }
+    bits = (uint32_t)(value < 0 ? value - 1 : value) & ((1u << category) - 1);
+    return category;
+}
+
+static void WriteDC(JpegBitWriter &bw, JpegComponent &comp, int dc) {
+    int diff = dc - comp.previousDC;
+    comp.previousDC = dc;
+    uint32_t bits;
+    int category = Category(diff, bits);
+    bw.Put(comp.dc.symbols[category]);
+    if (category > 0) {
+        bw.Put(bits, category);
+    }
+}
+
+static int RoundCoefficient(float v) {
+    return (int)(v < 0 ? v - 0.5f : v + 0.5f);
+}
+
+// AAN forward DCT of 8 values `stride` apart, scaled by AAN_SCALE.
+static void ForwardDCT(float *d, int stride) {
+    float tmp0 = d[0] + d[7 * stride];
+    float tmp7 = d[0] - d[7 * stride];
+    float tmp1 = d[stride] + d[6 * stride];
+    float tmp6 = d[stride] - d[6 * stride];
+    float tmp2 = d[2 * stride] + d[5 * stride];
+    float tmp5 = d[2 * stride] - d[5 * stride];
+    float tmp3 = d[3 * stride] + d[4 * stride];
+    float tmp4 = d[3 * stride] - d[4 * stride];
+
+    float tmp10 = tmp0 + tmp3;
+    float tmp13 = tmp0 - tmp3;
+    float tmp11 = tmp1 + tmp2;
+    float tmp12 = tmp1 - tmp2;
+
+    d[0] = tmp10 + tmp11;
+    d[4 * stride] = tmp10 - tmp11;
+    float z1 = (tmp12 + tmp13) * 0.707106781f;
+    d[2 * stride] = tmp13 + z1;
+    d[6 * stride] = tmp13 - z1;
+
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+    float z5 = (tmp10 - tmp12) * 0.382683433f;
+    float z2 = tmp10 * 0.541196100f + z5;
+    float z4 = tmp12 * 1.306562965f + z5;
+    float z3 = tmp11 * 0.707106781f;
+    float z11 = tmp7 + z3;
+    float z13 = tmp7 - z3;
+
+    d[5 * stride] = z13 + z2;
+    d[3 * stride] = z13 - z2;
+    d[stride] = z11 + z4;
+    d[7 * stride] = z11 - z4;
+}
+
+static void WriteBlock(JpegBitWriter &bw, JpegComponent &comp, float *block) {
+    for (int row = 0; row < 8; row++) {
+        ForwardDCT(block + row * 8, 1);
+    }
+    for (int col = 0; col < 8; col++) {
+        ForwardDCT(block + col, 8);
+    }
+
+    int coef[64];
+    for (int i = 0; i < 64; i++) {
+        coef[ZIGZAG[i]] = RoundCoefficient(block[i] * comp.divisors[i]);
+    }
+    WriteDC(bw, comp, coef[0]);
+
+    int last = 63;
+    while (last > 0 && coef[last] == 0) {
+        last--;
+    }
+    int zeros = 0;
+    for (int i = 1; i <= last; i++) {
+        if (coef[i] == 0) {
+            zeros++;
+            continue;
+        }
+        while (zeros >= 16) {
+            bw.Put(comp.ac.symbols[0xF0]);
+            zeros -= 16;
+        }
+        uint32_t bits;
+        int category = Category(coef[i], bits);
+        bw.Put(comp.ac.symbols[(zeros << 4) | category]);
+        bw.Put(bits, category);
+        zeros = 0;
+    }
+    if (last != 63) {
+        bw.Put(comp.ac.symbols[0x00]);
+    }
+}
+
+// A constant block transforms to a lone DC of 64 * v, which the quantizer
+// divides exactly like the full path does.
+static void WriteFlatBlock(JpegBitWriter &bw, JpegComponent &comp, float value) {
+    WriteDC(bw, comp, RoundCoefficient(value * 64 * comp.divisors[0]));
+    bw.Put(comp.ac.symbols[0x00]);
+}
+
+static void ToYCbCr(float r, float g, float b, float &y, float &cb, float &cr) {
+    y = 0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
+    cb = -0.16874f * r - 0.33126f * g + 0.50000f * b;
+    cr = 0.50000f * r - 0.41869f * g - 0.08131f * b;
+}
+
+// Marks the 8x8 blocks covered by a single leaf. Blocks on the right and
+// bottom edge only need their part inside the image to be covered, since
+// the encoder pads them by repeating the last column and row.
+static void MarkFlatBlocks(QuadTreeNode *node, int width, int height, int blocksX, std::vector<uint8_t> &flat) {
+    if (!node) {
+        return;
+    }
+    // Neither this node nor anything under it can cover a whole block.
+    int right = node->x + node->width, bottom = node->y + node->height;
+    if ((node->width < 8 && right != width) || (node->height < 8 && bottom != height)) {
+        return;
+    }
+    if (!node->isLeaf) {
+        for (int k = 0; k < 4; k++) {
+            MarkFlatBlocks(node->Child(k).get(), width, height, blocksX, flat);
+        }
+        return;
+    }
+
+    int bx0 = (node->x + 7) / 8, by0 = (node->y + 7) / 8;
+    int bx1 = right == width ? (width - 1) / 8 : right / 8 - 1;
+    int by1 = bottom == height ? (height - 1) / 8 : bottom / 8 - 1;
+    for (int by = by0; by <= by1; by++) {
+        for (int bx = bx0; bx <= bx1; bx++) {
+            flat[(size_t)by * blocksX + bx] = 1;
+        }
+    }
+}
+
+bool WriteQuadTreeJpeg(std::ostream &out, const uint8_t *rgb, size_t stride, int width, int height, std::unique_ptr<QuadTreeNode> &root, int quality) {
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535) {
+        return false;
+    }
+
+    quality = std::min(std::max(quality, 1), 100);
+    quality = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+    uint8_t yTable[64], uvTable[64];
+    for (int i = 0; i < 64; i++) {
+        int y = (Y_QUANT[i] * quality + 50) / 100;
+        int uv = (UV_QUANT[i] * quality + 50) / 100;
+        yTable[ZIGZAG[i]] = (uint8_t)std::min(std::max(y, 1), 255);
+        uvTable[ZIGZAG[i]] = (uint8_t)std::min(std::max(uv, 1), 255);
+    }
+
+    static const HuffmanTable dcLuma(DC_LUMA_COUNTS, DC_VALUES);
+    static const HuffmanTable acLuma(AC_LUMA_COUNTS, AC_LUMA_VALUES);
+    static const HuffmanTable dcChroma(DC_CHROMA_COUNTS, DC_VALUES);
+    static const HuffmanTable acChroma(AC_CHROMA_COUNTS, AC_CHROMA_VALUES);
+
+    JpegComponent comps[3] = {{dcLuma, acLuma, {}}, {dcChroma, acChroma, {}}, {dcChroma, acChroma, {}}};
+    for (int c = 0; c < 3; c++) {
+        const uint8_t *table = c == 0 ? yTable : uvTable;
+        for (int row = 0, k = 0; row < 8; row++) {
+            for (int col = 0; col < 8; col++, k++) {
+                comps[c].divisors[k] = 1 / (table[ZIGZAG[k]] * AAN_SCALE[row] * AAN_SCALE[col]);
+            }
+        }
+    }
+
+    std::vector<uint8_t> header = {
+        0xFF, 0xD8,
+        0xFF, 0xE0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0,
+        0xFF, 0xDB, 0, 132, 0};
+    header.insert(header.end(), yTable, yTable + 64);
+    header.push_back(1);
+    header.insert(header.end(), uvTable, uvTable + 64);
+
+    const uint8_t frame[] = {
+        0xFF, 0xC0, 0, 17, 8, (uint8_t)(height >> 8), (uint8_t)height, (uint8_t)(width >> 8), (uint8_t)width,
+        3, 1, 0x11, 0, 2, 0x11, 1, 3, 0x11, 1};
+    header.insert(header.end(), frame, frame + sizeof(frame));
+
+    const uint8_t *huffmanCounts[4] = {DC_LUMA_COUNTS, AC_LUMA_COUNTS, DC_CHROMA_COUNTS, AC_CHROMA_COUNTS};
+    const uint8_t *huffmanValues[4] = {DC_VALUES, AC_LUMA_VALUES, DC_VALUES, AC_CHROMA_VALUES};
+    const uint8_t huffmanIds[4] = {0x00, 0x10, 0x01, 0x11};
+    header.insert(header.end(), {0xFF, 0xC4, 0x01, 0xA2});
+    for (int t = 0; t < 4; t++) {
+        header.push_back(huffmanIds[t]);
+        header.insert(header.end(), huffmanCounts[t], huffmanCounts[t] + 16);
+        int n = 0;
+        for (int i = 0; i < 16; i++) {
+            n += huffmanCounts[t][i];
+        }
+        header.insert(header.end(), huffmanValues[t], huffmanValues[t] + n);
+    }
+    header.insert(header.end(), {0xFF, 0xDA, 0, 12, 3, 1, 0, 2, 0x11, 3, 0x11, 0, 0x3F, 0});
+    out.write((const char *)header.data(), header.size());
+
+    int blocksX = (width + 7) / 8, blocksY = (height + 7) / 8;
+    std::vector<uint8_t> flat((size_t)blocksX * blocksY, 0);
+    MarkFlatBlocks(root.get(), width, height, blocksX, flat);
+
+    JpegBitWriter bw;
+    bw.bytes.reserve((size_t)blocksX * blocksY * 8);
+    float planes[3][64];
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            int x0 = bx * 8, y0 = by * 8;
+            if (flat[(size_t)by * blocksX + bx]) {
+                const uint8_t *p = rgb + (size_t)y0 * stride + (size_t)x0 * 3;
+                float y, cb, cr;
+                ToYCbCr(p[0], p[1], p[2], y, cb, cr);
+                WriteFlatBlock(bw, comps[0], y);
+                WriteFlatBlock(bw, comps[1], cb);
+                WriteFlatBlock(bw, comps[2], cr);
+                continue;
+            }
+
+            for (int row = 0, k = 0; row < 8; row++) {
+                const uint8_t *line = rgb + (size_t)std::min(y0 + row, height - 1) * stride;
+                for (int col = 0; col < 8; col++, k++) {
+                    const uint8_t *p = line + (size_t)std::min(x0 + col, width - 1) * 3;
+                    ToYCbCr(p[0], p[1], p[2], planes[0][k], planes[1][k], planes[2][k]);
+                }
+            }
+            for (int c = 0; c < 3; c++) {
+                WriteBlock(bw, comps[c], planes[c]);
+            }
+        }
+    }
+    bw.Flush();
+
+    out.write((const char *)bw.bytes.data(), bw.bytes.size());
+    const uint8_t eoi[2] = {0xFF, 0xD9};
+    out.write((const char *)eoi, 2);
+    return (bool)out;
+}
@@ -0,0 +1,16 @@
+#ifndef JPEG_WRITER_HPP
+#define JPEG_WRITER_HPP
+
+#include "QuadTree.hpp"
+#include <ostream>
+
+// Baseline JPEG (4:4:4, standard Huffman tables, stb's quality scaling) of a
+// reconstructed quadtree image (`stride` bytes per row of packed RGB).
+// Every 8x8 block that lies inside a single leaf is constant, so its DC
+// coefficient is computed straight from the leaf color and it is written as
+// DC + EOB without running the DCT. Only blocks that cross a leaf boundary
+// go through the full transform. The output is the same as for a full
+// transform of every block.
+bool WriteQuadTreeJpeg(std::ostream &out, const uint8_t *rgb, size_t stride, int width, int height, std::unique_ptr<QuadTreeNode> &root, int quality);
+
+#endif
@@ -0,0 +1,78 @@
+#include "LeafPalette.hpp"
+#include "iff2gif.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+static void CollectLeaves(QuadTreeNode *node, std::vector<QuadTreeNode *> &leaves) {
+    if (!node) {
+        return;
+    }
+    if (node->isLeaf) {
+        leaves.push_back(node);
+        return;
+    }
+    for (int k = 0; k < 4; k++) {
+        CollectLeaves(node->Child(k).get(), leaves);
+    }
+}
+
+static uint32_t PackColor(const RGBPixel &c) {
+    return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16);
+}
+
+std::vector<uint32_t> QuantizerWeights(const std::vector<uint64_t> &areas) {
+    uint64_t totalArea = 0;
+    for (uint64_t area : areas) totalArea += area;
+    double scale = totalArea ? std::min(64.0 * areas.size(), 262144.0) / totalArea : 0;
+
+    std::vector<uint32_t> weights(areas.size());
+    for (size_t i = 0; i < areas.size(); i++) {
+        weights[i] = (uint32_t)std::max(1.0, std::round(areas[i] * scale));
+    }
+    return weights;
+}
+
+std::vector<uint8_t> QuantizeLeaves(std::unique_ptr<QuadTreeNode> &root, int width, int height, int quantizer, std::vector<RGBPixel> &palette) {
+    std::vector<QuadTreeNode *> leaves;
+    CollectLeaves(root.get(), leaves);
+
+    std::unordered_map<uint32_t, size_t> slots;
+    std::vector<uint64_t> areas;
+    // Quantizers take 4 bytes per pixel.
+    std::vector<uint8_t> colors;
+    for (QuadTreeNode *leaf : leaves) {
+        auto it = slots.emplace(PackColor(leaf->color), areas.size()).first;
+        if (it->second == areas.size()) {
+            areas.push_back(0);
+            colors.insert(colors.end(), {leaf->color.r, leaf->color.g, leaf->color.b, 0});
+        }
+        areas[it->second] += (uint64_t)leaf->width * leaf->height;
+    }
+    std::vector<uint32_t> weights = QuantizerWeights(areas);
+
+    std::unique_ptr<Quantizer> q(QuantizerFactory[quantizer](256));
+    q->AddWeightedPixels(colors.data(), weights.data(), weights.size());
+    Palette pal = q->GetPalette();
+
+    palette.clear();
+    for (size_t i = 0; i < pal.size(); i++) {
+        palette.emplace_back(pal[i].red, pal[i].green, pal[i].blue);
+    }
+
+    std::vector<uint8_t> indices((size_t)width * height, 0);
+    std::unordered_map<uint32_t, uint8_t> nearest;
+    for (QuadTreeNode *leaf : leaves) {
+        uint32_t key = PackColor(leaf->color);
+        auto it = nearest.find(key);
+        if (it == nearest.end()) {
+            it = nearest.emplace(key, (uint8_t)pal.NearestColor(leaf->color.r, leaf->color.g, leaf->color.b)).first;
+        }
+        for (int i = 0; i < leaf->height; i++) {
+            memset(&indices[(size_t)(leaf->y + i) * width + leaf->x], it->second, leaf->width);
+        }
+    }
+    return indices;
+}
@@ -0,0 +1,18 @@
+#ifndef LEAF_PALETTE_HPP
+#define LEAF_PALETTE_HPP
+
+#include "QuadTree.hpp"
+
+// Turns per-color areas into quantizer weights. NeuQuant learns from about
+// one sample per unit of weight, so the areas are scaled down to roughly 64
+// samples per color, at most 2^18 in all (but at least 1 per color). This
+// also keeps MedianCut's 32-bit bin counts from overflowing.
+std::vector<uint32_t> QuantizerWeights(const std::vector<uint64_t> &areas);
+
+// Quantizes the leaf colors of the tree to at most 256 entries with one of
+// the iff2gif quantizers (QUANTIZER_MedianCut or QUANTIZER_NeuQuant). Each
+// leaf color is weighted by its area. Returns the width * height index image
+// and fills `palette`.
+std::vector<uint8_t> QuantizeLeaves(std::unique_ptr<QuadTreeNode> &root, int width, int height, int quantizer, std::vector<RGBPixel> &palette);
+
+#endif
@@ -0,0 +1,129 @@
+#include "MappedFile.hpp"
+#include "ImageLoadException.hpp"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &fileName) {
+    if (fileName == "-") {
+        _setmode(_fileno(stdin), _O_BINARY);
+        uint8_t chunk[1 << 16];
+        size_t count;
+        while ((count = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+            buffer.insert(buffer.end(), chunk, chunk + count);
+        }
+        if (ferror(stdin)) {
+            throw ImageLoadException("Can't read standard input");
+        }
+        data = buffer.data();
+        size = buffer.size();
+        return;
+    }
+
+    HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw ImageLoadException("Can't open file: " + fileName);
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        throw ImageLoadException("Cannot get file size: " + fileName);
+    }
+    fileHandle = file;
+    size = (size_t)fileSize.QuadPart;
+    if (size == 0) {
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        throw ImageLoadException("Can't map file: " + fileName);
+    }
+    mappingHandle = mapping;
+    data = (const uint8_t *)view;
+    mapped = true;
+}
+
+MappedFile::~MappedFile() {
+    if (mapped) UnmapViewOfFile(data);
+    if (mappingHandle) CloseHandle((HANDLE)mappingHandle);
+    if (fileHandle) CloseHandle((HANDLE)fileHandle);
+}
+
+void MappedFile::AdviseSequential() const {}
+
+#else
+
+MappedFile::MappedFile(const std::string &fileName) {
+    bool standardInput = fileName == "-";
+    int fd = standardInput ? STDIN_FILENO : open(fileName.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw ImageLoadException("Can't open file: " + fileName);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        if (!standardInput) close(fd);
+        throw ImageLoadException("Can't map file: " + fileName);
+    }
+
+    if (standardInput || !S_ISREG(st.st_mode)) {
+        uint8_t chunk[1 << 16];
+        ssize_t count;
+        while ((count = read(fd, chunk, sizeof(chunk))) != 0) {
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                if (!standardInput) close(fd);
+                throw ImageLoadException("Can't read file: " + fileName);
+            }
+            buffer.insert(buffer.end(), chunk, chunk + count);
+        }
+        if (!standardInput) close(fd);
+        data = buffer.data();
+        size = buffer.size();
+        return;
+    }
+
+    size = (size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        return;
+    }
+
+    void *view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        throw ImageLoadException("Can't map file: " + fileName);
+    }
+    data = (const uint8_t *)view;
+    mapped = true;
+}
+
+MappedFile::~MappedFile() {
+    if (mapped) munmap((void *)data, size);
+}
+
+void MappedFile::AdviseSequential() const {
+    if (Mapped()) {
+        madvise((void *)data, size, MADV_SEQUENTIAL);
+    }
+}
+
+#endif
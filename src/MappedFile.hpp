@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. Regular files are memory-mapped; standard
+// input ("-") and pipes, which can't be mapped, are read into memory
+// instead. Throws ImageLoadException when the file can't be opened or read.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &fileName);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *Data() const { return data; }
+    size_t Size() const { return size; }
+
+    // False when the contents were read from a stream.
+    bool Mapped() const { return mapped; }
+
+    // Hints that the mapping will be read once from front to back, so the
+    // kernel reads ahead aggressively and drops pages behind the reader.
+    void AdviseSequential() const;
+
+private:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::vector<uint8_t> buffer;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+};
+
+#endif
@@ -1,52 +1,66 @@
 #include "Metrics.hpp"
 
-double CalculateVariance(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth) {
+RGBPixel CalculateAverageColor(const ImageBuffer &image, int x, int y, int width, int height) {
+    uint64_t r = 0, g = 0, b = 0;
+    for (int i = y; i < y + height; i++) {
+        for (int j = x; j < x + width; j++) {
+            const uint8_t *pixel = image.Row(i) + (size_t)j * image.channels;
+            r += pixel[0];
+            g += pixel[1];
+            b += pixel[2];
+        }
+    }
+    uint64_t totalPixel = (uint64_t)width * height;
+    return RGBPixel((uint8_t)(r / totalPixel), (uint8_t)(g / totalPixel), (uint8_t)(b / totalPixel));
+}
+
+double CalculateVariance(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor) {
     double variance = 0.0;
 
     for (int i = y; i < y + height; i++) {
         for (int j = x; j < x + width; j++) {
-            int idx = i * imageWidth + j;
-            variance += (image[idx].r - avgColor.r) * (image[idx].r - avgColor.r) +
-                        (image[idx].r - avgColor.g) * (image[idx].r - avgColor.g) +
-                        (image[idx].r - avgColor.b) * (image[idx].r - avgColor.b);
+            const uint8_t *pixel = image.Row(i) + (size_t)j * image.channels;
+            variance += (pixel[0] - avgColor.r) * (pixel[0] - avgColor.r) +
+                        (pixel[0] - avgColor.g) * (pixel[0] - avgColor.g) +
+                        (pixel[0] - avgColor.b) * (pixel[0] - avgColor.b);
         }
     }
 
-    return variance / (double)(3 * width * height);
+    return variance / (3.0 * width * height);
 }
 
-double CalculateMeanAbsoluteDeviation(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth) {
+double CalculateMeanAbsoluteDeviation(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor) {
     double mad = 0.0;
     
     for (int i = y; i < y + height; i++) {
         for (int j = x; j < x + width; j++) {
-            int idx = i * imageWidth + j;
-            mad += abs(image[idx].r - avgColor.r) +
-                   abs(image[idx].g - avgColor.g) +
-                   abs(image[idx].b - avgColor.b);
+            const uint8_t *pixel = image.Row(i) + (size_t)j * image.channels;
+            mad += abs(pixel[0] - avgColor.r) +
+                   abs(pixel[1] - avgColor.g) +
+                   abs(pixel[2] - avgColor.b);
         }
     }
     
-    return mad / (double)(3 * width * height);
+    return mad / (3.0 * width * height);
 }
 
-double CalculateMaxPixelDifference(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth) {
+double CalculateMaxPixelDifference(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor) {
     uint8_t minR = 255, maxR = 0;
     uint8_t minG = 255, maxG = 0;
     uint8_t minB = 255, maxB = 0;
 
     for (int i = y; i < y + height; i++) {
         for (int j = x; j < x + width; j++) {
-            int idx = i * imageWidth + j;
+            const uint8_t *pixel = image.Row(i) + (size_t)j * image.channels;
 
-            minR = std::min(minR, image[idx].r);
-            maxR = std::max(maxR, image[idx].r);
+            minR = std::min(minR, pixel[0]);
+            maxR = std::max(maxR, pixel[0]);
 
-            minG = std::min(minG, image[idx].g);
-            maxG = std::max(maxG, image[idx].g);
+            minG = std::min(minG, pixel[1]);
+            maxG = std::max(maxG, pixel[1]);
 
-            minB = std::min(minB, image[idx].b);
-            maxB = std::max(maxB, image[idx].b);
+            minB = std::min(minB, pixel[2]);
+            maxB = std::max(maxB, pixel[2]);
         }
     }
 
@@ -57,18 +71,18 @@ double CalculateMaxPixelDifference(const std::vector<RGBPixel> &image, int x, in
     return diffRGB;
 }
 
-double CalculateEntropy(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth) {
-    std::vector<int> freqR(256, 0), freqG(256, 0), freqB(256, 0);
+double CalculateEntropy(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor) {
+    std::vector<uint64_t> freqR(256, 0), freqG(256, 0), freqB(256, 0);
     for (int i = y; i < y + height; i++) {
         for (int j = x; j < x + width; j++) {
-            int idx = i * imageWidth + j;
-            freqR[image[idx].r]++;
-            freqG[image[idx].g]++;
-            freqB[image[idx].b]++;
+            const uint8_t *pixel = image.Row(i) + (size_t)j * image.channels;
+            freqR[pixel[0]]++;
+            freqG[pixel[1]]++;
+            freqB[pixel[2]]++;
         }
     }
     
-    int totalPixels = width * height;
+    double totalPixels = (double)width * height;
     double H = 0.0;
     for (int i = 0; i < 256; i++) {
         if (freqR[i] > 0) {
@@ -88,8 +102,8 @@ double CalculateEntropy(const std::vector<RGBPixel> &image, int x, int y, int wi
     return H / 3.0;
 }
 
-double CalculateSSIM(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth) {
-    int totalPixels = width * height;
+double CalculateSSIM(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor) {
+    double totalPixels = (double)width * height;
     double sum1R = 0.0, sum1R2 = 0.0, sum12R = 0.0;
     double sum1G = 0.0, sum1G2 = 0.0, sum12G = 0.0;
     double sum1B = 0.0, sum1B2 = 0.0, sum12B = 0.0;
@@ -100,18 +114,18 @@ double CalculateSSIM(const std::vector<RGBPixel> &image, int x, int y, int width
 
     for (int i = y; i < y + height; i++) {
         for (int j = x; j < x + width; j++) {
-            int idx = i * imageWidth + j;
-            double r1 = (double)image[idx].r;
+            const uint8_t *pixel = image.Row(i) + (size_t)j * image.channels;
+            double r1 = (double)pixel[0];
             sum1R += r1;
             sum1R2 += r1 * r1;
             sum12R += r1 * mean2R;
 
-            double g1 = (double)image[idx].g;
+            double g1 = (double)pixel[1];
             sum1G += g1;
             sum1G2 += g1 * g1;
             sum12G += g1 * mean2G;
 
-            double b1 = (double)image[idx].b;
+            double b1 = (double)pixel[2];
             sum1B += b1;
             sum1B2 += b1 * b1;
             sum12B += b1 * mean2B;
@@ -2,12 +2,14 @@
 #define METRICS_HPP
 
 #include "QuadTree.hpp"
+#include "ImageBuffer.hpp"
 #include <algorithm>
 
-double CalculateVariance(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth);
-double CalculateMeanAbsoluteDeviation(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth);
-double CalculateMaxPixelDifference(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth);
-double CalculateEntropy(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth);
-double CalculateSSIM(const std::vector<RGBPixel> &image, int x, int y, int width, int height, const RGBPixel &avgColor, int &imageWidth);
+RGBPixel CalculateAverageColor(const ImageBuffer &image, int x, int y, int width, int height);
+double CalculateVariance(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor);
+double CalculateMeanAbsoluteDeviation(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor);
+double CalculateMaxPixelDifference(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor);
+double CalculateEntropy(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor);
+double CalculateSSIM(const ImageBuffer &image, int x, int y, int width, int height, const RGBPixel &avgColor);
 
 #endif
\ No newline at end of file
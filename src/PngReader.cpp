@@ -0,0 +1,239 @@
+#include "PngReader.hpp"
+#include "ImageLoadException.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+static const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+static uint32_t ReadU32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Reads the next chunk's length and type. Returns false at end of file.
+static bool ReadChunkHeader(std::ifstream &file, uint32_t &length, char type[4]) {
+    uint8_t header[8];
+    if (!file.read((char *)header, 8)) {
+        return false;
+    }
+    length = ReadU32(header);
+    memcpy(type, header + 4, 4);
+    if (length > 0x7FFFFFFF) {
+        throw ImageLoadException("PNG chunk too large");
+    }
+    return true;
+}
+
+bool IsStreamablePng(const std::string &fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    uint8_t header[29];
+    if (!file.read((char *)header, sizeof(header))) {
+        return false;
+    }
+    return memcmp(header, PNG_SIGNATURE, 8) == 0 && memcmp(header + 12, "IHDR", 4) == 0 && header[28] == 0;
+}
+
+PngRowSource::PngRowSource(const std::string &fileName) : file(fileName, std::ios::binary) {
+    if (!file) {
+        throw ImageLoadException("Can't open file: " + fileName);
+    }
+
+    uint8_t signature[8];
+    if (!file.read((char *)signature, 8) || memcmp(signature, PNG_SIGNATURE, 8) != 0) {
+        throw ImageLoadException("Not a PNG file: " + fileName);
+    }
+
+    // Everything up to the first IDAT; its data is left for ReadCompressed.
+    bool sawHeader = false;
+    uint32_t length;
+    char type[4];
+    while (true) {
+        if (!ReadChunkHeader(file, length, type)) {
+            throw ImageLoadException("PNG file has no image data: " + fileName);
+        }
+
+        if (memcmp(type, "IHDR", 4) == 0) {
+            uint8_t ihdr[13];
+            if (length != 13 || !file.read((char *)ihdr, 13)) {
+                throw ImageLoadException("Invalid PNG header: " + fileName);
+            }
+            uint32_t w = ReadU32(ihdr), h = ReadU32(ihdr + 4);
+            bitDepth = ihdr[8];
+            colorType = ihdr[9];
+            if (w == 0 || h == 0 || w > 0x7FFFFFFF || h > 0x7FFFFFFF) {
+                throw ImageLoadException("PNG file has invalid dimensions: " + fileName);
+            }
+            if (ihdr[10] != 0 || ihdr[11] != 0) {
+                throw ImageLoadException("Unsupported PNG compression or filter method: " + fileName);
+            }
+            if (ihdr[12] != 0) {
+                throw ImageLoadException("Interlaced PNG files can't be streamed: " + fileName);
+            }
+
+            int samples;
+            switch (colorType)
+            {
+            case 0: samples = 1; break;
+            case 2: samples = 3; break;
+            case 3: samples = 1; break;
+            case 4: samples = 2; break;
+            case 6: samples = 4; break;
+            default:
+                throw ImageLoadException("Invalid PNG color type: " + fileName);
+            }
+            bool depthValid = bitDepth == 8 || (bitDepth == 16 && colorType != 3) ||
+                              ((bitDepth == 1 || bitDepth == 2 || bitDepth == 4) && (colorType == 0 || colorType == 3));
+            if (!depthValid) {
+                throw ImageLoadException("Invalid PNG bit depth: " + fileName);
+            }
+
+            width = (int)w;
+            height = (int)h;
+            size_t bitsPerPixel = (size_t)bitDepth * samples;
+            bytesPerPixel = bitsPerPixel < 8 ? 1 : bitsPerPixel / 8;
+            rowBytes = ((size_t)width * bitsPerPixel + 7) / 8;
+            sawHeader = true;
+        }
+        else if (memcmp(type, "PLTE", 4) == 0) {
+            if (length > sizeof(palette) || length % 3 != 0 || !file.read((char *)palette, length)) {
+                throw ImageLoadException("Invalid PNG palette: " + fileName);
+            }
+        }
+        else if (memcmp(type, "IDAT", 4) == 0) {
+            break;
+        }
+        else if (memcmp(type, "IEND", 4) == 0) {
+            throw ImageLoadException("PNG file has no image data: " + fileName);
+        }
+        else {
+            file.seekg(length, std::ios::cur);
+        }
+
+        // CRC
+        file.seekg(4, std::ios::cur);
+    }
+    if (!sawHeader) {
+        throw ImageLoadException("Invalid PNG header: " + fileName);
+    }
+
+    chunkLeft = length;
+    previous.assign(rowBytes + 1, 0);
+    current.resize(rowBytes + 1);
+    inflater = std::make_unique<Inflater>([this](uint8_t *dst, size_t size) { return ReadCompressed(dst, size); });
+}
+
+// The zlib stream is the concatenation of the consecutive IDAT chunks.
+size_t PngRowSource::ReadCompressed(uint8_t *dst, size_t size) {
+    while (chunkLeft == 0) {
+        if (dataEnded) {
+            return 0;
+        }
+        file.seekg(4, std::ios::cur);
+        uint32_t length;
+        char type[4];
+        if (!ReadChunkHeader(file, length, type) || memcmp(type, "IDAT", 4) != 0) {
+            dataEnded = true;
+            return 0;
+        }
+        chunkLeft = length;
+    }
+
+    size_t count = size < chunkLeft ? size : chunkLeft;
+    if (!file.read((char *)dst, count)) {
+        throw ImageLoadException("PNG file truncated");
+    }
+    chunkLeft -= (uint32_t)count;
+    return count;
+}
+
+// current = filter byte + filtered row; leaves the raw row in current + 1.
+void PngRowSource::Unfilter() {
+    uint8_t *row = current.data() + 1;
+    const uint8_t *up = previous.data() + 1;
+    size_t bpp = bytesPerPixel;
+
+    switch (current[0])
+    {
+    case 0:
+        break;
+    case 1:
+        for (size_t i = bpp; i < rowBytes; i++) row[i] += row[i - bpp];
+        break;
+    case 2:
+        for (size_t i = 0; i < rowBytes; i++) row[i] += up[i];
+        break;
+    case 3:
+        for (size_t i = 0; i < bpp && i < rowBytes; i++) row[i] += up[i] >> 1;
+        for (size_t i = bpp; i < rowBytes; i++) row[i] += (row[i - bpp] + up[i]) >> 1;
+        break;
+    case 4:
+        for (size_t i = 0; i < bpp && i < rowBytes; i++) row[i] += up[i];
+        for (size_t i = bpp; i < rowBytes; i++) {
+            int a = row[i - bpp], b = up[i], c = up[i - bpp];
+            int p = a + b - c;
+            int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+            row[i] += (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+        }
+        break;
+    default:
+        throw ImageLoadException("Invalid PNG filter type");
+    }
+}
+
+void PngRowSource::ConvertRow(uint8_t *dst) const {
+    const uint8_t *row = current.data() + 1;
+
+    if (bitDepth < 8) {
+        int mask = (1 << bitDepth) - 1;
+        int scale = colorType == 0 ? 255 / mask : 1;
+        for (int x = 0; x < width; x++) {
+            size_t bit = (size_t)x * bitDepth;
+            int value = (row[bit >> 3] >> (8 - bitDepth - (bit & 7))) & mask;
+            if (colorType == 3) {
+                memcpy(dst + x * 3, palette + value * 3, 3);
+            } else {
+                dst[x * 3] = dst[x * 3 + 1] = dst[x * 3 + 2] = (uint8_t)(value * scale);
+            }
+        }
+        return;
+    }
+
+    if (colorType == 2 && bitDepth == 8) {
+        memcpy(dst, row, (size_t)width * 3);
+        return;
+    }
+
+    // Byte offset of the high byte of each sample.
+    size_t step = bitDepth / 8;
+    size_t pixelBytes = bytesPerPixel;
+    for (int x = 0; x < width; x++) {
+        const uint8_t *p = row + (size_t)x * pixelBytes;
+        uint8_t *out = dst + (size_t)x * 3;
+        switch (colorType)
+        {
+        case 0:
+        case 4:
+            out[0] = out[1] = out[2] = p[0];
+            break;
+        case 3:
+            memcpy(out, palette + p[0] * 3, 3);
+            break;
+        default:
+            out[0] = p[0];
+            out[1] = p[step];
+            out[2] = p[2 * step];
+            break;
+        }
+    }
+}
+
+void PngRowSource::ReadRows(uint8_t *dst, size_t stride, int count) {
+    for (int row = 0; row < count; row++) {
+        if (inflater->Read(current.data(), rowBytes + 1) != rowBytes + 1) {
+            throw ImageLoadException("PNG file truncated");
+        }
+        Unfilter();
+        ConvertRow(dst + row * stride);
+        previous.swap(current);
+    }
+}
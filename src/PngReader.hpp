@@ -0,0 +1,43 @@
+#ifndef PNG_READER_HPP
+#define PNG_READER_HPP
+
+#include "Inflate.hpp"
+#include "RowSource.hpp"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Non-interlaced PNG decoded one row at a time. IDAT data is inflated only
+// as far as the rows asked for, so memory is the inflate window plus two
+// filtered rows whatever the image size. Every color type and bit depth is
+// converted to 8-bit RGB the same way stb_image does it (16-bit samples keep
+// their high byte, alpha is dropped). Ancillary chunks and CRCs are ignored.
+class PngRowSource : public RowSource
+{
+public:
+    explicit PngRowSource(const std::string &fileName);
+
+    void ReadRows(uint8_t *dst, size_t stride, int count) override;
+
+private:
+    std::ifstream file;
+    uint32_t chunkLeft = 0;
+    bool dataEnded = false;
+
+    int bitDepth = 0, colorType = 0;
+    size_t bytesPerPixel = 0, rowBytes = 0;
+    uint8_t palette[256 * 3] = {0};
+    std::vector<uint8_t> previous, current;
+    std::unique_ptr<Inflater> inflater;
+
+    size_t ReadCompressed(uint8_t *dst, size_t size);
+    void Unfilter();
+    void ConvertRow(uint8_t *dst) const;
+};
+
+// True when `fileName` starts with the PNG signature and its IHDR says the
+// image is not interlaced.
+bool IsStreamablePng(const std::string &fileName);
+
+#endif
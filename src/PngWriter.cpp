@@ -0,0 +1,157 @@
+#include "PngWriter.hpp"
+#include "Deflate.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size) {
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void PutU32BE(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static void WriteChunk(std::ostream &out, const char type[4], const uint8_t *data, size_t size) {
+    uint8_t header[8];
+    PutU32BE(header, (uint32_t)size);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = Crc32(0, header + 4, 4);
+    crc = Crc32(crc, data, size);
+
+    uint8_t trailer[4];
+    PutU32BE(trailer, crc);
+    out.write((const char *)header, 8);
+    out.write((const char *)data, size);
+    out.write((const char *)trailer, 4);
+}
+
+static void WriteHeader(std::ostream &out, int width, int height, uint8_t colorType) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.write((const char *)signature, sizeof(signature));
+
+    uint8_t ihdr[13];
+    PutU32BE(ihdr, (uint32_t)width);
+    PutU32BE(ihdr + 4, (uint32_t)height);
+    ihdr[8] = 8;            // bit depth
+    ihdr[9] = colorType;
+    ihdr[10] = 0;           // deflate
+    ihdr[11] = 0;           // adaptive filtering
+    ihdr[12] = 0;           // no interlace
+    WriteChunk(out, "IHDR", ihdr, sizeof(ihdr));
+}
+
+static bool WriteImageData(std::ostream &out, const std::vector<uint8_t> &filtered, size_t rowSize) {
+    // Chunk lengths are 31-bit, and readers handle small chunks better, so
+    // the zlib stream is split over IDAT chunks of at most 1 MiB.
+    const size_t maxChunk = 1 << 20;
+    std::vector<uint8_t> compressed = ZlibCompressRows(filtered.data(), filtered.size(), rowSize);
+    size_t offset = 0;
+    do {
+        size_t size = std::min(maxChunk, compressed.size() - offset);
+        WriteChunk(out, "IDAT", compressed.data() + offset, size);
+        offset += size;
+    } while (offset < compressed.size());
+    WriteChunk(out, "IEND", nullptr, 0);
+    return (bool)out;
+}
+
+static void MarkRowStarts(QuadTreeNode *node, std::vector<bool> &rowStarts) {
+    if (!node) {
+        return;
+    }
+    if (node->isLeaf) {
+        rowStarts[node->y] = true;
+        return;
+    }
+    for (int k = 0; k < 4; k++) {
+        MarkRowStarts(node->Child(k).get(), rowStarts);
+    }
+}
+
+bool WriteIndexedPng(std::ostream &out, const uint8_t *indices, int width, int height, const std::vector<RGBPixel> &palette) {
+    if (palette.empty() || palette.size() > 256) {
+        return false;
+    }
+    WriteHeader(out, width, height, 3);
+
+    std::vector<uint8_t> plte;
+    for (const RGBPixel &c : palette) {
+        plte.push_back(c.r);
+        plte.push_back(c.g);
+        plte.push_back(c.b);
+    }
+    WriteChunk(out, "PLTE", plte.data(), plte.size());
+
+    // Filters don't help index data, every row uses filter type 0.
+    std::vector<uint8_t> filtered((size_t)(width + 1) * height);
+    for (int y = 0; y < height; y++) {
+        uint8_t *row = &filtered[(size_t)y * (width + 1)];
+        row[0] = 0;
+        memcpy(row + 1, indices + (size_t)y * width, width);
+    }
+    return WriteImageData(out, filtered, (size_t)width + 1);
+}
+
+bool WriteQuadTreePng(std::ostream &out, const uint8_t *rgb, size_t stride, int width, int height, std::unique_ptr<QuadTreeNode> &root) {
+    WriteHeader(out, width, height, 2);
+
+    std::vector<bool> rowStarts(height, false);
+    MarkRowStarts(root.get(), rowStarts);
+
+    size_t rowBytes = (size_t)width * 3;
+    std::vector<uint8_t> filtered((rowBytes + 1) * height);
+    std::vector<uint8_t> up(rowBytes);
+    for (int y = 0; y < height; y++) {
+        uint8_t *dst = &filtered[(size_t)y * (rowBytes + 1)];
+        const uint8_t *src = rgb + (size_t)y * stride;
+        if (y > 0 && !rowStarts[y]) {
+            dst[0] = 2;
+            memset(dst + 1, 0, rowBytes);
+            continue;
+        }
+
+        // Sub is zero inside every span, Up is zero outside the leaves that
+        // start on this row. Keep whichever leaves fewer nonzero bytes.
+        size_t subNonzero = 0;
+        dst[0] = 1;
+        for (size_t i = 0; i < rowBytes; i++) {
+            uint8_t v = i < 3 ? src[i] : (uint8_t)(src[i] - src[i - 3]);
+            dst[1 + i] = v;
+            subNonzero += v != 0;
+        }
+        if (y == 0) continue;
+
+        const uint8_t *above = src - stride;
+        size_t upNonzero = 0;
+        for (size_t i = 0; i < rowBytes; i++) {
+            up[i] = (uint8_t)(src[i] - above[i]);
+            upNonzero += up[i] != 0;
+        }
+        if (upNonzero < subNonzero) {
+            dst[0] = 2;
+            memcpy(dst + 1, up.data(), rowBytes);
+        }
+    }
+    return WriteImageData(out, filtered, rowBytes + 1);
+}
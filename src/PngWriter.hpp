@@ -0,0 +1,18 @@
+#ifndef PNG_WRITER_HPP
+#define PNG_WRITER_HPP
+
+#include "QuadTree.hpp"
+#include <ostream>
+
+// Palette PNG (color type 3, one byte per pixel). `indices` holds
+// width * height palette indices, row after row.
+bool WriteIndexedPng(std::ostream &out, const uint8_t *indices, int width, int height, const std::vector<RGBPixel> &palette);
+
+// Truecolor PNG of a reconstructed quadtree image (`stride` bytes per row
+// of packed RGB). A row on which no leaf starts is identical to the one
+// above and is written with the Up filter, every other row with Sub, so
+// flat blocks turn into runs of zeros that ZlibCompressRows turns into long
+// matches.
+bool WriteQuadTreePng(std::ostream &out, const uint8_t *rgb, size_t stride, int width, int height, std::unique_ptr<QuadTreeNode> &root);
+
+#endif
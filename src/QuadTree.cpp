@@ -6,3 +6,28 @@ RGBPixel::RGBPixel(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {}
 QuadTreeNode::QuadTreeNode(int x, int y, int width, int height, RGBPixel color, bool isLeaf)
     : x(x), y(y), width(width), height(height), color(color), isLeaf(isLeaf),
       atasKiri(nullptr), atasKanan(nullptr), bawahKiri(nullptr), bawahKanan(nullptr) {}
+
+std::unique_ptr<QuadTreeNode> &QuadTreeNode::Child(int index) {
+    switch (index) {
+    case 0:
+        return atasKiri;
+    case 1:
+        return atasKanan;
+    case 2:
+        return bawahKiri;
+    default:
+        return bawahKanan;
+    }
+}
+
+void ChildRect(int x, int y, int w, int h, int index, int &cx, int &cy, int &cw, int &ch) {
+    int halfWidth = w / 2;
+    int halfHeight = h / 2;
+    bool right = (index & 1) != 0;
+    bool bottom = (index & 2) != 0;
+
+    cx = right ? x + halfWidth : x;
+    cy = bottom ? y + halfHeight : y;
+    cw = right ? w - halfWidth : halfWidth;
+    ch = bottom ? h - halfHeight : halfHeight;
+}
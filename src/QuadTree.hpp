@@ -24,6 +24,13 @@ public:
     std::unique_ptr<QuadTreeNode> atasKiri, atasKanan, bawahKiri, bawahKanan;
 
     QuadTreeNode(int x, int y, int width, int height, RGBPixel color, bool isLeaf);
+
+    // 0 = atasKiri, 1 = atasKanan, 2 = bawahKiri, 3 = bawahKanan
+    std::unique_ptr<QuadTreeNode> &Child(int index);
 };
 
-#endif
\ No newline at end of file
+// Rectangle of child `index` of the block (x, y, w, h), split the same way
+// as BuildQuadTree does it.
+void ChildRect(int x, int y, int w, int h, int index, int &cx, int &cy, int &cw, int &ch);
+
+#endif
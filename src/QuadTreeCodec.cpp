@@ -0,0 +1,659 @@
+#include "QuadTreeCodec.hpp"
+#include "ImageLoadException.hpp"
+#include "RangeCoder.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+static const char QTC_MAGIC[4] = {'Q', 'T', 'C', '1'};
+
+static void WriteU32(std::ostream &out, uint32_t v) {
+    uint8_t bytes[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+    out.write((const char *)bytes, 4);
+}
+
+static uint32_t ReadU32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+class BitWriter
+{
+public:
+    std::vector<uint8_t> bytes;
+    size_t bitCount = 0;
+
+    void Put(bool bit) {
+        if (bitCount % 8 == 0) {
+            bytes.push_back(0);
+        }
+        if (bit) {
+            bytes.back() |= (uint8_t)(0x80 >> (bitCount % 8));
+        }
+        bitCount++;
+    }
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t *data, size_t size) : data(data), bitLimit(size * 8) {}
+
+    bool Get() {
+        if (bitPos >= bitLimit) {
+            throw ImageLoadException("Quadtree file truncated (split flags)");
+        }
+        bool bit = (data[bitPos / 8] & (0x80 >> (bitPos % 8))) != 0;
+        bitPos++;
+        return bit;
+    }
+
+private:
+    const uint8_t *data;
+    size_t bitLimit;
+    size_t bitPos = 0;
+};
+
+static void WriteRaw(QuadTreeNode *node, BitWriter &splits, std::vector<uint8_t> &colors) {
+    if (!node) {
+        return;
+    }
+
+    splits.Put(!node->isLeaf);
+    if (node->isLeaf) {
+        colors.push_back(node->color.r);
+        colors.push_back(node->color.g);
+        colors.push_back(node->color.b);
+        return;
+    }
+
+    for (int k = 0; k < 4; k++) {
+        WriteRaw(node->Child(k).get(), splits, colors);
+    }
+}
+
+// Internal nodes are not stored, so they get the area-weighted mean of their children.
+static void AverageFromChildren(QuadTreeNode *node) {
+    uint64_t r = 0, g = 0, b = 0, area = 0;
+    for (int k = 0; k < 4; k++) {
+        QuadTreeNode *child = node->Child(k).get();
+        if (!child) continue;
+        uint64_t a = (uint64_t)child->width * child->height;
+        r += child->color.r * a;
+        g += child->color.g * a;
+        b += child->color.b * a;
+        area += a;
+    }
+    if (area > 0) {
+        node->color = RGBPixel((uint8_t)(r / area), (uint8_t)(g / area), (uint8_t)(b / area));
+    }
+}
+
+static std::unique_ptr<QuadTreeNode> ReadRaw(int x, int y, int w, int h, BitReader &splits, const uint8_t *colors, size_t colorSize, size_t &colorPos) {
+    if (w <= 0 || h <= 0) {
+        return nullptr;
+    }
+
+    if (!splits.Get()) {
+        if (colorPos + 3 > colorSize) {
+            throw ImageLoadException("Quadtree file truncated (leaf colors)");
+        }
+        RGBPixel color(colors[colorPos], colors[colorPos + 1], colors[colorPos + 2]);
+        colorPos += 3;
+        return std::make_unique<QuadTreeNode>(x, y, w, h, color, true);
+    }
+
+    if (w == 1 && h == 1) {
+        throw ImageLoadException("Quadtree file is corrupt: split of a single pixel");
+    }
+
+    auto node = std::make_unique<QuadTreeNode>(x, y, w, h, RGBPixel(), false);
+    for (int k = 0; k < 4; k++) {
+        int cx, cy, cw, ch;
+        ChildRect(x, y, w, h, k, cx, cy, cw, ch);
+        node->Child(k) = ReadRaw(cx, cy, cw, ch, splits, colors, colorSize, colorPos);
+    }
+    AverageFromChildren(node.get());
+    return node;
+}
+
+struct RangeModel
+{
+    static constexpr int DEPTHS = 16;
+    static constexpr int COLOR_DEPTHS = 4;
+
+    uint16_t split[DEPTHS][4];
+    AdaptiveByteModel color[COLOR_DEPTHS][3];
+
+    RangeModel() {
+        for (auto &probs : split) {
+            for (uint16_t &p : probs) {
+                p = RC_PROB_INIT;
+            }
+        }
+    }
+
+    uint16_t &Split(int depth, int neighbors) {
+        return split[std::min(depth, DEPTHS - 1)][neighbors];
+    }
+
+    AdaptiveByteModel *Color(int depth) {
+        return color[std::min(depth / 3, COLOR_DEPTHS - 1)];
+    }
+};
+
+static int ZigZag(int residual) {
+    int8_t s = (int8_t)residual;
+    return s >= 0 ? 2 * s : -2 * s - 1;
+}
+
+static int UnZigZag(int symbol) {
+    return (symbol & 1) ? -((symbol + 1) / 2) : symbol / 2;
+}
+
+// Green residual first, red and blue relative to it.
+static void EncodeColor(RangeEncoder &rc, AdaptiveByteModel *models, const RGBPixel &c, const RGBPixel &p) {
+    int dg = c.g - p.g;
+    models[0].Encode(rc, ZigZag(dg));
+    models[1].Encode(rc, ZigZag(c.r - p.r - dg));
+    models[2].Encode(rc, ZigZag(c.b - p.b - dg));
+}
+
+static RGBPixel DecodeColor(RangeDecoder &rc, AdaptiveByteModel *models, const RGBPixel &p) {
+    int dg = UnZigZag(models[0].Decode(rc));
+    int dr = UnZigZag(models[1].Decode(rc));
+    int db = UnZigZag(models[2].Decode(rc));
+    return RGBPixel((uint8_t)(p.r + dr + dg), (uint8_t)(p.g + dg), (uint8_t)(p.b + db + dg));
+}
+
+// Siblings already coded: the one to the left (bit 1) and the one above (bit 0).
+static int SiblingContext(int index, const bool splits[4]) {
+    int left = (index & 1) ? splits[index - 1] : 0;
+    int above = (index & 2) ? splits[index - 2] : 0;
+    return left * 2 + above;
+}
+
+// The parent color is the mean of its children, so once the other children
+// are known the last one is predicted from what is left of the parent's sum.
+static RGBPixel PredictLastChild(QuadTreeNode *node, int last, int64_t lastArea) {
+    int64_t area = (int64_t)node->width * node->height;
+    int64_t sum[3] = {node->color.r * area, node->color.g * area, node->color.b * area};
+    for (int k = 0; k < last; k++) {
+        QuadTreeNode *child = node->Child(k).get();
+        if (!child) continue;
+        int64_t a = (int64_t)child->width * child->height;
+        sum[0] -= child->color.r * a;
+        sum[1] -= child->color.g * a;
+        sum[2] -= child->color.b * a;
+    }
+
+    uint8_t c[3];
+    for (int i = 0; i < 3; i++) {
+        c[i] = (uint8_t)std::clamp<int64_t>((sum[i] + lastArea / 2) / lastArea, 0, 255);
+    }
+    return RGBPixel(c[0], c[1], c[2]);
+}
+
+static int LastChild(QuadTreeNode *node) {
+    for (int k = 3; k > 0; k--) {
+        if (node->Child(k)) return k;
+    }
+    return 0;
+}
+
+static void WriteRange(QuadTreeNode *node, const RGBPixel &parentColor, int depth, int neighbors, RangeEncoder &rc, RangeModel &model) {
+    if ((int64_t)node->width * node->height > 1) {
+        rc.EncodeBit(model.Split(depth, neighbors), !node->isLeaf);
+    }
+    EncodeColor(rc, model.Color(depth), node->color, parentColor);
+    if (node->isLeaf) {
+        return;
+    }
+
+    bool splits[4] = {false, false, false, false};
+    int last = LastChild(node);
+    for (int k = 0; k < 4; k++) {
+        QuadTreeNode *child = node->Child(k).get();
+        if (!child) continue;
+        RGBPixel prediction = k == last ? PredictLastChild(node, last, (int64_t)child->width * child->height) : node->color;
+        WriteRange(child, prediction, depth + 1, SiblingContext(k, splits), rc, model);
+        splits[k] = !child->isLeaf;
+    }
+}
+
+static std::unique_ptr<QuadTreeNode> ReadRange(int x, int y, int w, int h, const RGBPixel &parentColor, int depth, int neighbors, RangeDecoder &rc, RangeModel &model) {
+    if (w <= 0 || h <= 0) {
+        return nullptr;
+    }
+    if (rc.Overrun()) {
+        throw ImageLoadException("Quadtree file truncated (range coded data)");
+    }
+
+    bool split = (int64_t)w * h > 1 && rc.DecodeBit(model.Split(depth, neighbors));
+    RGBPixel color = DecodeColor(rc, model.Color(depth), parentColor);
+    auto node = std::make_unique<QuadTreeNode>(x, y, w, h, color, !split);
+    if (!split) {
+        return node;
+    }
+
+    bool splits[4] = {false, false, false, false};
+    int last = 0;
+    int rects[4][4];
+    for (int k = 0; k < 4; k++) {
+        ChildRect(x, y, w, h, k, rects[k][0], rects[k][1], rects[k][2], rects[k][3]);
+        if (rects[k][2] > 0 && rects[k][3] > 0) last = k;
+    }
+    for (int k = 0; k < 4; k++) {
+        const int *r = rects[k];
+        RGBPixel prediction = k == last ? PredictLastChild(node.get(), last, (int64_t)r[2] * r[3]) : color;
+        node->Child(k) = ReadRange(r[0], r[1], r[2], r[3], prediction, depth + 1, SiblingContext(k, splits), rc, model);
+        splits[k] = node->Child(k) && !node->Child(k)->isLeaf;
+    }
+    return node;
+}
+
+static void WriteProgressive(std::ostream &out, QuadTreeNode *root) {
+    if (!root) {
+        return;
+    }
+    out.put((char)root->color.r);
+    out.put((char)root->color.g);
+    out.put((char)root->color.b);
+
+    std::vector<QuadTreeNode *> level = {root}, next;
+    std::vector<uint8_t> mask, colors;
+    while (!level.empty()) {
+        mask.assign((level.size() + 7) / 8, 0);
+        colors.clear();
+        next.clear();
+        for (size_t i = 0; i < level.size(); i++) {
+            QuadTreeNode *node = level[i];
+            if (node->isLeaf) continue;
+            mask[i / 8] |= (uint8_t)(0x80 >> (i % 8));
+            for (int k = 0; k < 4; k++) {
+                QuadTreeNode *child = node->Child(k).get();
+                if (!child) continue;
+                next.push_back(child);
+                colors.push_back(child->color.r);
+                colors.push_back(child->color.g);
+                colors.push_back(child->color.b);
+            }
+        }
+        out.write((const char *)mask.data(), mask.size());
+        out.write((const char *)colors.data(), colors.size());
+        level.swap(next);
+    }
+}
+
+size_t ProgressiveQuadTreeDecoder::UnitSize() const {
+    switch (phase)
+    {
+    case HEADER:
+        return QTC_HEADER_SIZE;
+    case ROOT_COLOR:
+    case COLORS:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+void ProgressiveQuadTreeDecoder::Feed(const uint8_t *data, size_t size) {
+    while (size > 0 && phase != DONE) {
+        size_t unit = UnitSize();
+        if (partial.empty() && size >= unit) {
+            Consume(data);
+            data += unit;
+            size -= unit;
+            continue;
+        }
+        size_t take = std::min(unit - partial.size(), size);
+        partial.insert(partial.end(), data, data + take);
+        data += take;
+        size -= take;
+        if (partial.size() == unit) {
+            std::vector<uint8_t> full;
+            full.swap(partial);
+            Consume(full.data());
+        }
+    }
+}
+
+void ProgressiveQuadTreeDecoder::Consume(const uint8_t *unit) {
+    switch (phase)
+    {
+    case HEADER:
+        if (memcmp(unit, QTC_MAGIC, sizeof(QTC_MAGIC)) != 0 || unit[12] != QTC_PROGRESSIVE) {
+            throw ImageLoadException("Not a progressive quadtree stream");
+        }
+        width = (int)ReadU32(unit + 4);
+        height = (int)ReadU32(unit + 8);
+        if (width <= 0 || height <= 0) {
+            throw ImageLoadException("Quadtree file has invalid dimensions");
+        }
+        root = std::make_unique<QuadTreeNode>(0, 0, width, height, RGBPixel(), true);
+        phase = ROOT_COLOR;
+        break;
+
+    case ROOT_COLOR:
+        root->color = RGBPixel(unit[0], unit[1], unit[2]);
+        level = {root.get()};
+        index = 0;
+        phase = MASK;
+        break;
+
+    case MASK:
+        for (int bit = 0; bit < 8 && index < level.size(); bit++, index++) {
+            if (!(unit[0] & (0x80 >> bit))) continue;
+            QuadTreeNode *node = level[index];
+            if ((int64_t)node->width * node->height <= 1) {
+                throw ImageLoadException("Quadtree file is corrupt: split of a single pixel");
+            }
+            // Children start out with the parent's color until their own arrives.
+            node->isLeaf = false;
+            for (int k = 0; k < 4; k++) {
+                int cx, cy, cw, ch;
+                ChildRect(node->x, node->y, node->width, node->height, k, cx, cy, cw, ch);
+                if (cw <= 0 || ch <= 0) continue;
+                node->Child(k) = std::make_unique<QuadTreeNode>(cx, cy, cw, ch, node->color, true);
+                next.push_back(node->Child(k).get());
+            }
+        }
+        if (index == level.size()) {
+            index = 0;
+            phase = next.empty() ? DONE : COLORS;
+        }
+        break;
+
+    case COLORS:
+        next[index]->color = RGBPixel(unit[0], unit[1], unit[2]);
+        if (++index == next.size()) {
+            level.swap(next);
+            next.clear();
+            index = 0;
+            phase = MASK;
+        }
+        break;
+
+    case DONE:
+        break;
+    }
+}
+
+static const size_t QTC_RECORD_SIZE = 8;
+
+// Node indices are 32-bit; returns false for a tree that has more nodes.
+static bool WriteIndexed(std::ostream &out, QuadTreeNode *root) {
+    std::vector<QuadTreeNode *> order;
+    if (root) {
+        order.push_back(root);
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        QuadTreeNode *node = order[i];
+        if (node->isLeaf) continue;
+        for (int k = 0; k < 4; k++) {
+            if (node->Child(k)) order.push_back(node->Child(k).get());
+        }
+    }
+
+    if (order.size() > UINT32_MAX) {
+        return false;
+    }
+
+    WriteU32(out, (uint32_t)order.size());
+    uint32_t nextChild = 1;
+    for (QuadTreeNode *node : order) {
+        uint8_t record[4] = {node->color.r, node->color.g, node->color.b, (uint8_t)(node->isLeaf ? 0 : 1)};
+        out.write((const char *)record, sizeof(record));
+        WriteU32(out, node->isLeaf ? 0 : nextChild);
+        if (!node->isLeaf) {
+            for (int k = 0; k < 4; k++) {
+                if (node->Child(k)) nextChild++;
+            }
+        }
+    }
+    return true;
+}
+
+// Children of a split node that actually exist (non-zero area).
+static int ChildRects(int x, int y, int w, int h, int rects[4][4]) {
+    int count = 0;
+    for (int k = 0; k < 4; k++) {
+        int *r = rects[count];
+        ChildRect(x, y, w, h, k, r[0], r[1], r[2], r[3]);
+        if (r[2] > 0 && r[3] > 0) count++;
+    }
+    return count;
+}
+
+static const uint8_t *IndexedRecord(const uint8_t *nodes, uint32_t nodeCount, uint32_t index) {
+    if (index >= nodeCount) {
+        throw ImageLoadException("Quadtree file is corrupt: node index out of range");
+    }
+    return nodes + (size_t)index * QTC_RECORD_SIZE;
+}
+
+static uint32_t IndexedFirstChild(const uint8_t *record, uint32_t index, int childCount, uint32_t nodeCount) {
+    uint32_t first = ReadU32(record + 4);
+    if (first <= index || (uint64_t)first + childCount > nodeCount) {
+        throw ImageLoadException("Quadtree file is corrupt: bad child index");
+    }
+    return first;
+}
+
+static std::unique_ptr<QuadTreeNode> ReadIndexed(const uint8_t *nodes, uint32_t nodeCount, uint32_t index, int x, int y, int w, int h) {
+    const uint8_t *record = IndexedRecord(nodes, nodeCount, index);
+    bool split = (record[3] & 1) != 0;
+    auto node = std::make_unique<QuadTreeNode>(x, y, w, h, RGBPixel(record[0], record[1], record[2]), !split);
+    if (!split) {
+        return node;
+    }
+
+    int rects[4][4];
+    int count = ChildRects(x, y, w, h, rects);
+    uint32_t first = IndexedFirstChild(record, index, count, nodeCount);
+    for (int k = 0, c = 0; k < 4; k++) {
+        int cx, cy, cw, ch;
+        ChildRect(x, y, w, h, k, cx, cy, cw, ch);
+        if (cw <= 0 || ch <= 0) continue;
+        node->Child(k) = ReadIndexed(nodes, nodeCount, first + c, cx, cy, cw, ch);
+        c++;
+    }
+    return node;
+}
+
+IndexedQuadTreeFile::IndexedQuadTreeFile(const std::string &fileName) : ownedFile(std::make_unique<MappedFile>(fileName)) {
+    Open(*ownedFile, fileName);
+}
+
+IndexedQuadTreeFile::IndexedQuadTreeFile(const MappedFile &file, const std::string &fileName) {
+    Open(file, fileName);
+}
+
+void IndexedQuadTreeFile::Open(const MappedFile &file, const std::string &fileName) {
+    const uint8_t *data = file.Data();
+    size_t size = file.Size();
+    if (size < QTC_HEADER_SIZE + 4 || memcmp(data, QTC_MAGIC, sizeof(QTC_MAGIC)) != 0 || data[12] != QTC_INDEXED) {
+        throw ImageLoadException("Not an indexed quadtree file: " + fileName);
+    }
+
+    width = (int)ReadU32(data + 4);
+    height = (int)ReadU32(data + 8);
+    nodeCount = ReadU32(data + QTC_HEADER_SIZE);
+    nodes = data + QTC_HEADER_SIZE + 4;
+    if (width <= 0 || height <= 0 || nodeCount == 0) {
+        throw ImageLoadException("Quadtree file has invalid dimensions");
+    }
+    if ((uint64_t)nodeCount * QTC_RECORD_SIZE > size - QTC_HEADER_SIZE - 4) {
+        throw ImageLoadException("Quadtree file truncated (node records)");
+    }
+}
+
+static int64_t CeilDiv(int64_t a, int64_t b) {
+    return a >= 0 ? (a + b - 1) / b : -((-a) / b);
+}
+
+// First output pixel whose center lies at or after source coordinate `edge`.
+static int64_t MapEdge(int64_t edge, int64_t viewStart, int64_t viewLength, int64_t outLength) {
+    int64_t o = CeilDiv(2 * (edge - viewStart) * outLength - viewLength, 2 * viewLength);
+    return std::clamp<int64_t>(o, 0, outLength);
+}
+
+std::vector<RGBPixel> IndexedQuadTreeFile::RenderViewport(int vx, int vy, int vw, int vh, int outWidth, int outHeight) const {
+    if (vw <= 0 || vh <= 0 || outWidth <= 0 || outHeight <= 0) {
+        throw ImageLoadException("Invalid viewport size");
+    }
+
+    std::vector<RGBPixel> out((size_t)outWidth * outHeight);
+    Viewport view = {vx, vy, vw, vh, outWidth, outHeight};
+    RenderNode(0, 0, 0, width, height, view, out);
+    return out;
+}
+
+void IndexedQuadTreeFile::RenderNode(uint32_t index, int x, int y, int w, int h, const Viewport &view, std::vector<RGBPixel> &out) const {
+    int64_t ox0 = MapEdge(x, view.x, view.w, view.outWidth);
+    int64_t ox1 = MapEdge((int64_t)x + w, view.x, view.w, view.outWidth);
+    int64_t oy0 = MapEdge(y, view.y, view.h, view.outHeight);
+    int64_t oy1 = MapEdge((int64_t)y + h, view.y, view.h, view.outHeight);
+    if (ox0 >= ox1 || oy0 >= oy1) {
+        return;
+    }
+
+    const uint8_t *record = IndexedRecord(nodes, nodeCount, index);
+    bool split = (record[3] & 1) != 0;
+    if (!split || (ox1 - ox0 == 1 && oy1 - oy0 == 1)) {
+        RGBPixel color(record[0], record[1], record[2]);
+        for (int64_t oy = oy0; oy < oy1; oy++) {
+            std::fill(out.begin() + oy * view.outWidth + ox0, out.begin() + oy * view.outWidth + ox1, color);
+        }
+        return;
+    }
+
+    int rects[4][4];
+    int count = ChildRects(x, y, w, h, rects);
+    uint32_t first = IndexedFirstChild(record, index, count, nodeCount);
+    for (int c = 0; c < count; c++) {
+        RenderNode(first + c, rects[c][0], rects[c][1], rects[c][2], rects[c][3], view, out);
+    }
+}
+
+bool EncodeQuadTree(std::ostream &out, std::unique_ptr<QuadTreeNode> &root, int width, int height, QuadTreeCoding coding) {
+    out.write(QTC_MAGIC, sizeof(QTC_MAGIC));
+    WriteU32(out, (uint32_t)width);
+    WriteU32(out, (uint32_t)height);
+    out.put((char)coding);
+
+    switch (coding)
+    {
+    case QTC_RAW:
+    {
+        BitWriter splits;
+        std::vector<uint8_t> colors;
+        WriteRaw(root.get(), splits, colors);
+
+        WriteU32(out, (uint32_t)splits.bytes.size());
+        out.write((const char *)splits.bytes.data(), splits.bytes.size());
+        out.write((const char *)colors.data(), colors.size());
+        break;
+    }
+    case QTC_RANGE:
+    {
+        RangeEncoder rc;
+        RangeModel model;
+        if (root) {
+            WriteRange(root.get(), RGBPixel(128, 128, 128), 0, 0, rc, model);
+        }
+        rc.Finish();
+        out.write((const char *)rc.bytes.data(), rc.bytes.size());
+        break;
+    }
+    case QTC_PROGRESSIVE:
+        WriteProgressive(out, root.get());
+        break;
+    case QTC_INDEXED:
+        if (!WriteIndexed(out, root.get())) {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    return (bool)out;
+}
+
+std::unique_ptr<QuadTreeNode> DecodeQuadTree(std::istream &in, int &width, int &height) {
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return DecodeQuadTree(data.data(), data.size(), width, height);
+}
+
+std::unique_ptr<QuadTreeNode> DecodeQuadTree(const uint8_t *data, size_t size, int &width, int &height) {
+    const size_t headerSize = QTC_HEADER_SIZE;
+    if (size < headerSize || memcmp(data, QTC_MAGIC, sizeof(QTC_MAGIC)) != 0) {
+        throw ImageLoadException("Not a quadtree file");
+    }
+
+    width = (int)ReadU32(data + 4);
+    height = (int)ReadU32(data + 8);
+    uint8_t coding = data[12];
+    if (width <= 0 || height <= 0) {
+        throw ImageLoadException("Quadtree file has invalid dimensions");
+    }
+
+    const uint8_t *payload = data + headerSize;
+    size_t payloadSize = size - headerSize;
+
+    switch (coding)
+    {
+    case QTC_RAW:
+    {
+        if (payloadSize < 4) {
+            throw ImageLoadException("Quadtree file truncated (header)");
+        }
+        size_t splitBytes = ReadU32(payload);
+        if (splitBytes > payloadSize - 4) {
+            throw ImageLoadException("Quadtree file truncated (split flags)");
+        }
+        BitReader splits(payload + 4, splitBytes);
+        const uint8_t *colors = payload + 4 + splitBytes;
+        size_t colorPos = 0;
+        return ReadRaw(0, 0, width, height, splits, colors, payloadSize - 4 - splitBytes, colorPos);
+    }
+    case QTC_RANGE:
+    {
+        RangeDecoder rc(payload, payloadSize);
+        RangeModel model;
+        return ReadRange(0, 0, width, height, RGBPixel(128, 128, 128), 0, 0, rc, model);
+    }
+    case QTC_PROGRESSIVE:
+    {
+        // A truncated stream still decodes to the coarser image it contains.
+        ProgressiveQuadTreeDecoder decoder;
+        decoder.Feed(data, size);
+        return std::move(decoder.Root());
+    }
+    case QTC_INDEXED:
+    {
+        if (payloadSize < 4) {
+            throw ImageLoadException("Quadtree file truncated (header)");
+        }
+        uint32_t nodeCount = ReadU32(payload);
+        if (nodeCount == 0 || (uint64_t)nodeCount * QTC_RECORD_SIZE > payloadSize - 4) {
+            throw ImageLoadException("Quadtree file truncated (node records)");
+        }
+        return ReadIndexed(payload + 4, nodeCount, 0, 0, 0, width, height);
+    }
+    default:
+        throw ImageLoadException("Unknown quadtree coding: " + std::to_string(coding));
+    }
+}
+
+bool IsQuadTreeFile(const MappedFile &file, QuadTreeCoding *coding) {
+    if (file.Size() < QTC_HEADER_SIZE) {
+        return false;
+    }
+    if (coding) {
+        *coding = (QuadTreeCoding)file.Data()[12];
+    }
+    return memcmp(file.Data(), QTC_MAGIC, sizeof(QTC_MAGIC)) == 0;
+}
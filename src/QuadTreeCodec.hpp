@@ -0,0 +1,111 @@
+#ifndef QUADTREE_CODEC_HPP
+#define QUADTREE_CODEC_HPP
+
+#include "QuadTree.hpp"
+#include "MappedFile.hpp"
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Every quadtree file starts with the magic "QTC1", the image width and
+// height (uint32 little-endian) and one byte that selects the coding below.
+enum QuadTreeCoding : uint8_t
+{
+    // Preorder split bits followed by the raw RGB of every leaf.
+    QTC_RAW = 0,
+    // Adaptive range coding: split flags modeled by depth and sibling
+    // splits, every node color coded as a residual from its parent.
+    QTC_RANGE = 1,
+    // Breadth-first by depth: the root color, then for every level the
+    // split mask of its nodes followed by the colors of their children.
+    // Any prefix decodes to a valid (coarser) image.
+    QTC_PROGRESSIVE = 2,
+    // Node count followed by fixed 8-byte node records in breadth-first
+    // order: r, g, b, flags (bit 0 = split), uint32 index of the first
+    // child. Children of a node are contiguous, so any node can be reached
+    // from the root without reading the rest of the file.
+    QTC_INDEXED = 3,
+};
+
+static constexpr size_t QTC_HEADER_SIZE = 13;
+
+// Geometry of the four children follows BuildQuadTree, so only the split
+// flags and colors are stored. Children with zero area are never written.
+bool EncodeQuadTree(std::ostream &out, std::unique_ptr<QuadTreeNode> &root, int width, int height, QuadTreeCoding coding);
+std::unique_ptr<QuadTreeNode> DecodeQuadTree(std::istream &in, int &width, int &height);
+// Same, from bytes already in memory (e.g. a MappedFile), without copying them.
+std::unique_ptr<QuadTreeNode> DecodeQuadTree(const uint8_t *data, size_t size, int &width, int &height);
+
+// Looks at the header bytes already in `file`, so it works for piped input
+// too.
+bool IsQuadTreeFile(const MappedFile &file, QuadTreeCoding *coding = nullptr);
+
+// Incremental decoder for QTC_PROGRESSIVE streams. Bytes can be fed in
+// chunks of any size; after every Feed the tree returned by Root() is
+// complete, with nodes whose split flag or children colors haven't arrived
+// yet showing as leaves of the best color known so far. reconstructImage on
+// it gives the current preview.
+class ProgressiveQuadTreeDecoder
+{
+public:
+    void Feed(const uint8_t *data, size_t size);
+
+    bool HeaderReady() const { return phase > HEADER; }
+    bool Done() const { return phase == DONE; }
+    int Width() const { return width; }
+    int Height() const { return height; }
+    std::unique_ptr<QuadTreeNode> &Root() { return root; }
+
+private:
+    enum Phase { HEADER, ROOT_COLOR, MASK, COLORS, DONE };
+
+    Phase phase = HEADER;
+    int width = 0, height = 0;
+    std::unique_ptr<QuadTreeNode> root;
+    std::vector<QuadTreeNode *> level, next;
+    size_t index = 0;
+    std::vector<uint8_t> partial;
+
+    size_t UnitSize() const;
+    void Consume(const uint8_t *unit);
+};
+
+// Memory-mapped QTC_INDEXED file. Rendering a viewport only visits the
+// nodes that overlap it, and stops descending once a node covers at most
+// one output pixel, so the cost follows the number of visible nodes.
+class IndexedQuadTreeFile
+{
+public:
+    explicit IndexedQuadTreeFile(const std::string &fileName);
+    // Reads the nodes straight from `file` (which may hold piped input),
+    // which must outlive this object.
+    IndexedQuadTreeFile(const MappedFile &file, const std::string &fileName);
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    // Renders the source rectangle (vx, vy, vw, vh) scaled to
+    // outWidth x outHeight. Each output pixel takes the color of the leaf
+    // under its center, unless a node above that leaf already maps to just
+    // that one output pixel: then the pixel takes the node's color (the
+    // average of its block) and the node is not descended into. At 1:1 or
+    // larger scales this is exactly the leaf under the center.
+    std::vector<RGBPixel> RenderViewport(int vx, int vy, int vw, int vh, int outWidth, int outHeight) const;
+
+private:
+    struct Viewport
+    {
+        int64_t x, y, w, h;
+        int64_t outWidth, outHeight;
+    };
+
+    std::unique_ptr<MappedFile> ownedFile;
+    const uint8_t *nodes = nullptr;
+    uint32_t nodeCount = 0;
+    int width = 0, height = 0;
+
+    void Open(const MappedFile &file, const std::string &fileName);
+    void RenderNode(uint32_t index, int x, int y, int w, int h, const Viewport &view, std::vector<RGBPixel> &out) const;
+};
+
+#endif
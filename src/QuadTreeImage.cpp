@@ -0,0 +1,134 @@
+#include "QuadTreeImage.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+std::unique_ptr<QuadTreeNode> BuildQuadTree(const ImageBuffer &image, int x, int y, int w, int h, double threshold, int minBlockSize, int errorMeasurementChoice) {
+    if(w <= 0 || h <= 0) {
+        return nullptr;
+    }
+    
+    RGBPixel avgColor = CalculateAverageColor(image, x, y, w, h);
+    double error;
+
+    switch (errorMeasurementChoice)
+    {
+    case 1:
+        // Variance
+        error = CalculateVariance(image, x, y, w, h, avgColor);
+        break;
+    case 2:
+        // Mean Absolute Deviation (MAD)
+        error = CalculateMeanAbsoluteDeviation(image, x, y, w, h, avgColor);
+        break;
+    case 3:
+        // Max Pixel Difference
+        error = CalculateMaxPixelDifference(image, x, y, w, h, avgColor);
+        break;
+
+    case 4:
+        // Entropy
+        error = CalculateEntropy(image, x, y, w, h, avgColor);
+        break;
+
+    case 5:
+        // SSIM
+        double ssim = CalculateSSIM(image, x, y, w, h, avgColor);
+        error = 1.0 - ssim;
+        break;
+    }
+
+    // A single pixel cannot be split further, whatever the threshold.
+    if (error < threshold || (int64_t)w * h < minBlockSize || (w == 1 && h == 1))
+    {
+        return std::make_unique<QuadTreeNode>(x, y, w, h, avgColor, true);
+    }
+
+    int halfWidth = w / 2;
+    int remWidth = w - halfWidth;
+    int halfHeight = h / 2;
+    int remHeight = h - halfHeight;
+
+    auto node = std::make_unique<QuadTreeNode>(x, y, w, h, avgColor, false);
+    node->atasKiri = BuildQuadTree(image, x, y, halfWidth, halfHeight, threshold, minBlockSize, errorMeasurementChoice);
+    node->atasKanan = BuildQuadTree(image, x + halfWidth, y, remWidth, halfHeight, threshold, minBlockSize, errorMeasurementChoice);
+    node->bawahKiri = BuildQuadTree(image, x, y + halfHeight, halfWidth, remHeight, threshold, minBlockSize, errorMeasurementChoice);
+    node->bawahKanan = BuildQuadTree(image, x + halfWidth, y + halfHeight, remWidth, remHeight, threshold, minBlockSize, errorMeasurementChoice);
+    return node;
+}
+
+// Fills `count` RGB pixels with one color: the first pixel is written
+// directly, then the filled prefix is doubled with memcpy until the span is
+// full.
+static void FillSpan(uint8_t *dst, int count, RGBPixel color) {
+    if (count <= 0) {
+        return;
+    }
+    dst[0] = color.r;
+    dst[1] = color.g;
+    dst[2] = color.b;
+    size_t filled = 3, total = (size_t)count * 3;
+    while (filled < total) {
+        size_t n = std::min(filled, total - filled);
+        memcpy(dst + filled, dst, n);
+        filled += n;
+    }
+}
+
+// Reconstructs rows [bandStart, bandEnd) only. Subtrees outside the band
+// are skipped, and every leaf writes its first row as a span and copies it
+// to the rest of its rows inside the band.
+static void reconstructBand(ImageBuffer &outputImage, QuadTreeNode *node, int bandStart, int bandEnd) {
+    if (!node || node->y >= bandEnd || node->y + node->height <= bandStart) {
+        return;
+    }
+
+    if (node->isLeaf) {
+        int top = std::max(node->y, bandStart);
+        int bottom = std::min(node->y + node->height, bandEnd);
+        size_t offset = (size_t)node->x * 3, span = (size_t)node->width * 3;
+        uint8_t *first = outputImage.Row(top) + offset;
+        FillSpan(first, node->width, node->color);
+        for (int row = top + 1; row < bottom; row++) {
+            memcpy(outputImage.Row(row) + offset, first, span);
+        }
+        return;
+    }
+
+    reconstructBand(outputImage, node->atasKiri.get(), bandStart, bandEnd);
+    reconstructBand(outputImage, node->atasKanan.get(), bandStart, bandEnd);
+    reconstructBand(outputImage, node->bawahKiri.get(), bandStart, bandEnd);
+    reconstructBand(outputImage, node->bawahKanan.get(), bandStart, bandEnd);
+}
+
+// The image is split into horizontal bands that are reconstructed by
+// separate threads. Bands are disjoint row ranges and rows start on
+// 64-byte boundaries, so no two threads ever write to the same cache line.
+void reconstructImage(ImageBuffer &outputImage, std::unique_ptr<QuadTreeNode> &node) {
+    if (!node)
+    {
+        return;
+    }
+
+    const int minBandRows = 64;
+    int imageHeight = outputImage.height;
+    int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max(1, std::min(threads, imageHeight / minBandRows));
+    if (threads == 1) {
+        reconstructBand(outputImage, node.get(), 0, imageHeight);
+        return;
+    }
+
+    int bandRows = (imageHeight + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (int start = bandRows; start < imageHeight; start += bandRows) {
+        int end = std::min(start + bandRows, imageHeight);
+        workers.emplace_back(reconstructBand, std::ref(outputImage), node.get(), start, end);
+    }
+    reconstructBand(outputImage, node.get(), 0, bandRows);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef QUADTREE_IMAGE_HPP
+#define QUADTREE_IMAGE_HPP
+
+#include "QuadTree.hpp"
+#include "ImageBuffer.hpp"
+
+// Builds the subtree of the block (x, y, w, h): a block is split in four
+// until its error (by the metric `errorMeasurementChoice`, 1-5) is below
+// `threshold`, it has fewer than `minBlockSize` pixels, or it is a single
+// pixel.
+std::unique_ptr<QuadTreeNode> BuildQuadTree(const ImageBuffer &image, int x, int y, int w, int h, double threshold, int minBlockSize, int errorMeasurementChoice);
+
+// Paints every leaf of the tree into `outputImage`, which must already have
+// the tree's size.
+void reconstructImage(ImageBuffer &outputImage, std::unique_ptr<QuadTreeNode> &node);
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef RANGE_CODER_HPP
+#define RANGE_CODER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Carry-propagating range coder (LZMA style). Binary decisions use 11-bit
+// adaptive probabilities, multi-symbol alphabets use AdaptiveSymbolModel.
+
+static constexpr int RC_PROB_BITS = 11;
+static constexpr uint16_t RC_PROB_INIT = 1 << (RC_PROB_BITS - 1);
+static constexpr int RC_MOVE_BITS = 5;
+static constexpr uint32_t RC_TOP = 1u << 24;
+
+class RangeEncoder
+{
+public:
+    std::vector<uint8_t> bytes;
+
+    void EncodeBit(uint16_t &prob, int bit) {
+        uint32_t bound = (range >> RC_PROB_BITS) * prob;
+        if (!bit) {
+            range = bound;
+            prob += ((1 << RC_PROB_BITS) - prob) >> RC_MOVE_BITS;
+        }
+        else {
+            low += bound;
+            range -= bound;
+            prob -= prob >> RC_MOVE_BITS;
+        }
+        Normalize();
+    }
+
+    void EncodeFreq(uint32_t cumFreq, uint32_t freq, uint32_t totFreq) {
+        uint32_t r = range / totFreq;
+        low += (uint64_t)r * cumFreq;
+        range = r * freq;
+        Normalize();
+    }
+
+    void Finish() {
+        for (int i = 0; i < 5; i++) {
+            ShiftLow();
+        }
+    }
+
+private:
+    uint64_t low = 0;
+    uint32_t range = 0xFFFFFFFF;
+    uint8_t cache = 0;
+    uint64_t cacheSize = 1;
+
+    void Normalize() {
+        while (range < RC_TOP) {
+            range <<= 8;
+            ShiftLow();
+        }
+    }
+
+    void ShiftLow() {
+        if ((uint32_t)low < 0xFF000000u || (low >> 32) != 0) {
+            uint8_t carry = (uint8_t)(low >> 32);
+            uint8_t temp = cache;
+            do {
+                bytes.push_back((uint8_t)(temp + carry));
+                temp = 0xFF;
+            } while (--cacheSize != 0);
+            cache = (uint8_t)(low >> 24);
+        }
+        cacheSize++;
+        low = (low & 0x00FFFFFF) << 8;
+    }
+};
+
+class RangeDecoder
+{
+public:
+    RangeDecoder(const uint8_t *data, size_t size) : data(data), size(size) {
+        for (int i = 0; i < 5; i++) {
+            code = (code << 8) | NextByte();
+        }
+    }
+
+    int DecodeBit(uint16_t &prob) {
+        uint32_t bound = (range >> RC_PROB_BITS) * prob;
+        int bit;
+        if (code < bound) {
+            range = bound;
+            prob += ((1 << RC_PROB_BITS) - prob) >> RC_MOVE_BITS;
+            bit = 0;
+        }
+        else {
+            code -= bound;
+            range -= bound;
+            prob -= prob >> RC_MOVE_BITS;
+            bit = 1;
+        }
+        Normalize();
+        return bit;
+    }
+
+    // Returns the cumulative frequency the next symbol falls on. The caller
+    // looks the symbol up and then calls Consume with its interval.
+    uint32_t PeekFreq(uint32_t totFreq) {
+        step = range / totFreq;
+        uint32_t value = code / step;
+        return value < totFreq ? value : totFreq - 1;
+    }
+
+    void Consume(uint32_t cumFreq, uint32_t freq) {
+        code -= step * cumFreq;
+        range = step * freq;
+        Normalize();
+    }
+
+    // True once the decoder had to invent bytes past the end of the input.
+    bool Overrun() const { return pos > size + 4; }
+
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t pos = 0;
+    uint32_t code = 0;
+    uint32_t range = 0xFFFFFFFF;
+    uint32_t step = 1;
+
+    uint8_t NextByte() {
+        uint8_t b = pos < size ? data[pos] : 0;
+        pos++;
+        return b;
+    }
+
+    void Normalize() {
+        while (range < RC_TOP) {
+            range <<= 8;
+            code = (code << 8) | NextByte();
+        }
+    }
+};
+
+// Adaptive frequency table over a small alphabet of N symbols. Symbols are
+// searched linearly from 0, so the common ones should get small numbers.
+template <int N>
+class AdaptiveSymbolModel
+{
+public:
+    AdaptiveSymbolModel() {
+        for (int i = 0; i < N; i++) {
+            freq[i] = 1;
+        }
+        total = N;
+    }
+
+    void Encode(RangeEncoder &rc, int symbol) {
+        uint32_t cum = 0;
+        for (int i = 0; i < symbol; i++) {
+            cum += freq[i];
+        }
+        rc.EncodeFreq(cum, freq[symbol], total);
+        Update(symbol);
+    }
+
+    int Decode(RangeDecoder &rc) {
+        uint32_t target = rc.PeekFreq(total);
+        uint32_t cum = 0;
+        int symbol = 0;
+        while (symbol < N - 1 && cum + freq[symbol] <= target) {
+            cum += freq[symbol];
+            symbol++;
+        }
+        rc.Consume(cum, freq[symbol]);
+        Update(symbol);
+        return symbol;
+    }
+
+private:
+    static constexpr uint32_t INCREMENT = 32;
+    static constexpr uint32_t LIMIT = 1 << 16;
+
+    uint32_t freq[N];
+    uint32_t total;
+
+    void Update(int symbol) {
+        freq[symbol] += INCREMENT;
+        total += INCREMENT;
+        if (total > LIMIT) {
+            total = 0;
+            for (int i = 0; i < N; i++) {
+                freq[i] = (freq[i] + 1) / 2;
+                total += freq[i];
+            }
+        }
+    }
+};
+
+// Byte values coded as a magnitude class (bit length, 0..8) through a
+// symbol model, followed by the bits under the leading one, each with its
+// own adaptive probability.
+class AdaptiveByteModel
+{
+public:
+    AdaptiveByteModel() {
+        for (auto &probs : mantissa) {
+            for (uint16_t &p : probs) {
+                p = RC_PROB_INIT;
+            }
+        }
+    }
+
+    void Encode(RangeEncoder &rc, int value) {
+        int cls = 0;
+        while ((value >> cls) != 0) {
+            cls++;
+        }
+        classes.Encode(rc, cls);
+        for (int i = cls - 2; i >= 0; i--) {
+            rc.EncodeBit(mantissa[cls][i], (value >> i) & 1);
+        }
+    }
+
+    int Decode(RangeDecoder &rc) {
+        int cls = classes.Decode(rc);
+        if (cls == 0) {
+            return 0;
+        }
+        int value = 1;
+        for (int i = cls - 2; i >= 0; i--) {
+            value = (value << 1) | rc.DecodeBit(mantissa[cls][i]);
+        }
+        return value;
+    }
+
+private:
+    AdaptiveSymbolModel<9> classes;
+    uint16_t mantissa[9][8];
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "RowSource.hpp"
+#include "ImageLoadException.hpp"
+#include "PngReader.hpp"
+
+#include <cctype>
+#include <cstdio>
+#include <sys/stat.h>
+
+PpmRowSource::PpmRowSource(const std::string &fileName) : file(fileName, std::ios::binary) {
+    if (!file) {
+        throw ImageLoadException("Can't open file: " + fileName);
+    }
+
+    char magic[2];
+    if (!file.read(magic, 2) || magic[0] != 'P' || magic[1] != '6') {
+        throw ImageLoadException("Not a binary PPM file: " + fileName);
+    }
+
+    // Width, height and maxval, separated by whitespace and '#' comments.
+    long values[3];
+    for (long &value : values) {
+        int c = file.get();
+        while (c != EOF && (isspace(c) || c == '#')) {
+            if (c == '#') {
+                while (c != EOF && c != '\n') c = file.get();
+            }
+            c = file.get();
+        }
+        if (c == EOF || !isdigit(c)) {
+            throw ImageLoadException("Invalid PPM header: " + fileName);
+        }
+        value = 0;
+        while (c != EOF && isdigit(c) && value <= 0x7FFFFFFF) {
+            value = value * 10 + (c - '0');
+            c = file.get();
+        }
+        if (c == EOF || !isspace(c)) {
+            throw ImageLoadException("Invalid PPM header: " + fileName);
+        }
+    }
+
+    if (values[0] <= 0 || values[1] <= 0 || values[0] > 0x7FFFFFFF || values[1] > 0x7FFFFFFF) {
+        throw ImageLoadException("PPM file has invalid dimensions: " + fileName);
+    }
+    if (values[2] != 255) {
+        throw ImageLoadException("Only 8-bit PPM files are supported: " + fileName);
+    }
+    width = (int)values[0];
+    height = (int)values[1];
+}
+
+void PpmRowSource::ReadRows(uint8_t *dst, size_t stride, int count) {
+    size_t rowBytes = (size_t)width * 3;
+    for (int row = 0; row < count; row++) {
+        if (!file.read((char *)dst + row * stride, rowBytes)) {
+            throw ImageLoadException("PPM file truncated");
+        }
+    }
+}
+
+std::unique_ptr<RowSource> OpenRowSource(const std::string &fileName) {
+    // Probing a pipe would consume the bytes it reads.
+    struct stat st;
+    if (stat(fileName.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return nullptr;
+    }
+
+    std::ifstream file(fileName, std::ios::binary);
+    char magic[2];
+    if (file.read(magic, 2) && magic[0] == 'P' && magic[1] == '6') {
+        return std::make_unique<PpmRowSource>(fileName);
+    }
+    if (IsStreamablePng(fileName)) {
+        return std::make_unique<PngRowSource>(fileName);
+    }
+    return nullptr;
+}
@@ -0,0 +1,44 @@
+#ifndef ROW_SOURCE_HPP
+#define ROW_SOURCE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+// Image rows delivered from top to bottom, for inputs that are too large to
+// decode in one piece.
+class RowSource
+{
+public:
+    virtual ~RowSource() = default;
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    // Reads the next `count` rows as packed RGB, rows `stride` bytes apart.
+    // Throws ImageLoadException when the input ends early.
+    virtual void ReadRows(uint8_t *dst, size_t stride, int count) = 0;
+
+protected:
+    int width = 0, height = 0;
+};
+
+// Binary PPM (P6) with 8-bit samples.
+class PpmRowSource : public RowSource
+{
+public:
+    explicit PpmRowSource(const std::string &fileName);
+
+    void ReadRows(uint8_t *dst, size_t stride, int count) override;
+
+private:
+    std::ifstream file;
+};
+
+// Row source for `fileName` when it is a regular file in a format that can
+// be streamed (binary PPM, non-interlaced PNG), otherwise nullptr.
+std::unique_ptr<RowSource> OpenRowSource(const std::string &fileName);
+
+#endif
@@ -0,0 +1,311 @@
+#include "TiledQuadTree.hpp"
+#include "ImageLoadException.hpp"
+#include "QuadTreeCodec.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Same split as ChildRect: the first half gets size / 2.
+static void SplitInterval(int start, int size, int depth, std::vector<int> &starts, std::vector<int> &sizes) {
+    if (depth == 0) {
+        starts.push_back(start);
+        sizes.push_back(size);
+        return;
+    }
+    int half = size / 2;
+    SplitInterval(start, half, depth - 1, starts, sizes);
+    SplitInterval(start + half, size - half, depth - 1, starts, sizes);
+}
+
+struct TileRecord
+{
+    uint64_t offset = 0;
+    uint64_t bitCount = 0;
+    uint64_t leafCount = 0;
+    int depth = 0;
+    bool uniform = false;
+    RGBPixel color;
+};
+
+// Split flags (MSB first) and leaf colors of one subtree, as QTC_RAW lays
+// them out.
+static void SerializeSubtree(QuadTreeNode *node, int depth, std::vector<uint8_t> &bits, uint64_t &bitCount, std::vector<uint8_t> &colors, int &maxDepth) {
+    if (!node) {
+        return;
+    }
+    if (bitCount % 8 == 0) {
+        bits.push_back(0);
+    }
+    if (!node->isLeaf) {
+        bits.back() |= (uint8_t)(0x80 >> (bitCount % 8));
+    }
+    bitCount++;
+    maxDepth = std::max(maxDepth, depth);
+
+    if (node->isLeaf) {
+        colors.push_back(node->color.r);
+        colors.push_back(node->color.g);
+        colors.push_back(node->color.b);
+        return;
+    }
+    for (int k = 0; k < 4; k++) {
+        SerializeSubtree(node->Child(k).get(), depth + 1, bits, bitCount, colors, maxDepth);
+    }
+}
+
+// MSB-first bit stream written straight to a file.
+class StreamBitWriter
+{
+public:
+    explicit StreamBitWriter(std::ostream &out) : out(out) {}
+
+    void Put(uint32_t bits, int count) {
+        buffer = (buffer << count) | (bits & ((1u << count) - 1));
+        filled += count;
+        while (filled >= 8) {
+            pending.push_back((uint8_t)(buffer >> (filled - 8)));
+            filled -= 8;
+        }
+        if (pending.size() >= (1 << 20)) {
+            Drain();
+        }
+    }
+
+    // Appends `bitCount` bits stored MSB first in `data`.
+    void Append(const uint8_t *data, uint64_t bitCount) {
+        uint64_t whole = bitCount / 8;
+        for (uint64_t i = 0; i < whole; i++) {
+            Put(data[i], 8);
+        }
+        int rest = (int)(bitCount % 8);
+        if (rest > 0) {
+            Put(data[whole] >> (8 - rest), rest);
+        }
+    }
+
+    void Flush() {
+        if (filled > 0) {
+            Put(0, 8 - filled);
+        }
+        Drain();
+    }
+
+private:
+    std::ostream &out;
+    std::vector<uint8_t> pending;
+    uint64_t buffer = 0;
+    int filled = 0;
+
+    void Drain() {
+        out.write((const char *)pending.data(), pending.size());
+        pending.clear();
+    }
+};
+
+class TileStitcher
+{
+public:
+    TileStitcher(int tileDepth, std::vector<TileRecord> &tiles, std::fstream &spill)
+        : tileDepth(tileDepth), grid(1 << tileDepth), tiles(tiles), spill(spill) {}
+
+    // Split flags and leaves of the whole tree, and the stats.
+    void Count(uint64_t &bitCount, TiledStats &stats) {
+        bitCount = 0;
+        stats = TiledStats();
+        Count(0, 0, 0, bitCount, stats);
+    }
+
+    void WriteSplits(StreamBitWriter &bits) { WriteSplits(0, 0, 0, bits); }
+    void WriteColors(std::ostream &out) { WriteColors(0, 0, 0, out); }
+
+private:
+    int tileDepth;
+    int grid;
+    std::vector<TileRecord> &tiles;
+    std::fstream &spill;
+    std::vector<uint8_t> chunk;
+
+    TileRecord &Tile(int row, int col) { return tiles[(size_t)row * grid + col]; }
+
+    // True when every tile under the node is a single leaf of one color.
+    bool Uniform(int depth, int row, int col, RGBPixel &color) {
+        if (depth == tileDepth) {
+            const TileRecord &tile = Tile(row, col);
+            color = tile.color;
+            return tile.uniform;
+        }
+        int span = (grid >> depth) / 2;
+        RGBPixel first;
+        if (!Uniform(depth + 1, row, col, first)) {
+            return false;
+        }
+        const int offsets[3][2] = {{0, 1}, {1, 0}, {1, 1}};
+        for (const auto &o : offsets) {
+            RGBPixel other;
+            if (!Uniform(depth + 1, row + o[0] * span, col + o[1] * span, other) ||
+                other.r != first.r || other.g != first.g || other.b != first.b) {
+                return false;
+            }
+        }
+        color = first;
+        return true;
+    }
+
+    template <typename Visit>
+    void ForChildren(int depth, int row, int col, Visit visit) {
+        int span = (grid >> depth) / 2;
+        visit(row, col);
+        visit(row, col + span);
+        visit(row + span, col);
+        visit(row + span, col + span);
+    }
+
+    void Count(int depth, int row, int col, uint64_t &bitCount, TiledStats &stats) {
+        RGBPixel color;
+        if (depth == tileDepth) {
+            const TileRecord &tile = Tile(row, col);
+            bitCount += tile.bitCount;
+            stats.nodeCount += tile.bitCount;
+            stats.maxDepth = std::max(stats.maxDepth, depth + tile.depth + 1);
+            return;
+        }
+        bitCount++;
+        stats.nodeCount++;
+        if (Uniform(depth, row, col, color)) {
+            stats.maxDepth = std::max(stats.maxDepth, depth + 1);
+            return;
+        }
+        ForChildren(depth, row, col, [&](int r, int c) { Count(depth + 1, r, c, bitCount, stats); });
+    }
+
+    // Reads `size` bytes of the spill file at `offset` into `chunk`.
+    void ReadSpill(uint64_t offset, size_t size) {
+        chunk.resize(size);
+        spill.seekg((std::streamoff)offset);
+        if (!spill.read((char *)chunk.data(), size)) {
+            throw ImageLoadException("Can't read the tile spill file");
+        }
+    }
+
+    void WriteSplits(int depth, int row, int col, StreamBitWriter &bits) {
+        RGBPixel color;
+        if (depth == tileDepth) {
+            const TileRecord &tile = Tile(row, col);
+            ReadSpill(tile.offset, (size_t)((tile.bitCount + 7) / 8));
+            bits.Append(chunk.data(), tile.bitCount);
+            return;
+        }
+        if (Uniform(depth, row, col, color)) {
+            bits.Put(0, 1);
+            return;
+        }
+        bits.Put(1, 1);
+        ForChildren(depth, row, col, [&](int r, int c) { WriteSplits(depth + 1, r, c, bits); });
+    }
+
+    void WriteColors(int depth, int row, int col, std::ostream &out) {
+        RGBPixel color;
+        if (depth == tileDepth) {
+            const TileRecord &tile = Tile(row, col);
+            ReadSpill(tile.offset + (tile.bitCount + 7) / 8, (size_t)tile.leafCount * 3);
+            out.write((const char *)chunk.data(), chunk.size());
+            return;
+        }
+        if (Uniform(depth, row, col, color)) {
+            const uint8_t rgb[3] = {color.r, color.g, color.b};
+            out.write((const char *)rgb, 3);
+            return;
+        }
+        ForChildren(depth, row, col, [&](int r, int c) { WriteColors(depth + 1, r, c, out); });
+    }
+};
+
+static void WriteU32(std::ostream &out, uint32_t v) {
+    uint8_t bytes[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+    out.write((const char *)bytes, 4);
+}
+
+bool CompressTiled(RowSource &source, const std::string &outputPath, const SubtreeBuilder &build, size_t bandBytes, TiledStats &stats) {
+    int width = source.Width(), height = source.Height();
+
+    // Deepest useful depth keeps every tile at least one pixel wide and high.
+    int tileDepth = 0;
+    while ((1 << (tileDepth + 1)) <= std::min(width, height) &&
+           (size_t)width * 3 * ((height + (1 << tileDepth) - 1) >> tileDepth) > bandBytes) {
+        tileDepth++;
+    }
+    int grid = 1 << tileDepth;
+
+    std::vector<int> rowStarts, rowSizes, colStarts, colSizes;
+    SplitInterval(0, height, tileDepth, rowStarts, rowSizes);
+    SplitInterval(0, width, tileDepth, colStarts, colSizes);
+
+    std::string spillPath = outputPath + ".tiles";
+    std::fstream spill(spillPath, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    if (!spill) {
+        throw ImageLoadException("Can't create the tile spill file: " + spillPath);
+    }
+
+    std::vector<TileRecord> tiles((size_t)grid * grid);
+    ImageBuffer band;
+    std::vector<uint8_t> bits, colors;
+    uint64_t offset = 0;
+    for (int row = 0; row < grid; row++) {
+        band.Resize(width, rowSizes[row]);
+        source.ReadRows(band.Data(), band.stride, rowSizes[row]);
+
+        for (int col = 0; col < grid; col++) {
+            TileRecord &tile = tiles[(size_t)row * grid + col];
+            std::unique_ptr<QuadTreeNode> subtree = build(band, colStarts[col], 0, colSizes[col], rowSizes[row]);
+
+            bits.clear();
+            colors.clear();
+            SerializeSubtree(subtree.get(), 0, bits, tile.bitCount, colors, tile.depth);
+            tile.offset = offset;
+            tile.leafCount = colors.size() / 3;
+            tile.uniform = subtree && subtree->isLeaf;
+            if (subtree) {
+                tile.color = subtree->color;
+            }
+            subtree.reset();
+
+            spill.write((const char *)bits.data(), bits.size());
+            spill.write((const char *)colors.data(), colors.size());
+            offset += bits.size() + colors.size();
+        }
+    }
+    if (!spill.flush()) {
+        std::remove(spillPath.c_str());
+        throw ImageLoadException("Can't write the tile spill file: " + spillPath);
+    }
+
+    TileStitcher stitcher(tileDepth, tiles, spill);
+    uint64_t bitCount;
+    stitcher.Count(bitCount, stats);
+    uint64_t splitBytes = (bitCount + 7) / 8;
+    if (splitBytes > 0xFFFFFFFFull) {
+        std::remove(spillPath.c_str());
+        return false;
+    }
+
+    bool success;
+    {
+        std::ofstream out(outputPath, std::ios::binary);
+        out.write("QTC1", 4);
+        WriteU32(out, (uint32_t)width);
+        WriteU32(out, (uint32_t)height);
+        out.put((char)QTC_RAW);
+        WriteU32(out, (uint32_t)splitBytes);
+
+        StreamBitWriter splitWriter(out);
+        stitcher.WriteSplits(splitWriter);
+        splitWriter.Flush();
+        stitcher.WriteColors(out);
+        success = (bool)out;
+    }
+
+    spill.close();
+    std::remove(spillPath.c_str());
+    return success;
+}
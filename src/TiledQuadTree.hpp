@@ -0,0 +1,34 @@
+#ifndef TILED_QUADTREE_HPP
+#define TILED_QUADTREE_HPP
+
+#include "ImageBuffer.hpp"
+#include "QuadTree.hpp"
+#include "RowSource.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Builds the subtree of the block (x, y, w, h) of `band`. The band holds
+// the full image width but only the rows of the current tile row, so y is
+// relative to the band.
+using SubtreeBuilder = std::function<std::unique_ptr<QuadTreeNode>(const ImageBuffer &band, int x, int y, int w, int h)>;
+
+struct TiledStats
+{
+    uint64_t nodeCount = 0;
+    int maxDepth = 0;
+};
+
+// Writes a QTC_RAW file without ever holding the whole image or tree.
+//
+// The tiles are the nodes at depth k of the quadtree, with k the smallest
+// depth at which one row of tiles fits in `bandBytes`. Rows of tiles are
+// read one band at a time. Every tile's subtree is built and serialized
+// (split flags and leaf colors) to a spill file next to the output, and
+// then freed. The nodes above the tiles are always split, except where all
+// the tiles below one of them are single leaves of the same color; those
+// are merged into one leaf. Finally the spilled subtrees are stitched into
+// one preorder stream under that top tree.
+bool CompressTiled(RowSource &source, const std::string &outputPath, const SubtreeBuilder &build, size_t bandBytes, TiledStats &stats);
+
+#endif
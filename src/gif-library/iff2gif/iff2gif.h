@@ -291,6 +291,8 @@ public:
 	bool empty() const { return Histo.empty(); }
 
 	void AddPixels(const uint8_t *src, size_t numpixels, uint8_t mins[3], uint8_t maxs[3]);
+	// Same as above, but pixel j counts as weights[j] pixels. (weights may be NULL.)
+	void AddPixels(const uint8_t *src, const uint32_t *weights, size_t numpixels, uint8_t mins[3], uint8_t maxs[3]);
 	Palette ToPalette() const;
 
 private:
@@ -304,6 +306,8 @@ public:
 	virtual ~Quantizer();
 	virtual void AddPixels(const ChunkyBitmap &bitmap);
 	virtual void AddPixels(const uint8_t *rgb, size_t count) = 0;
+	// Pixel i is counted weights[i] times, e.g. a color weighted by the area it covers.
+	virtual void AddWeightedPixels(const uint8_t *rgb, const uint32_t *weights, size_t count) = 0;
 	virtual Palette GetPalette() = 0;
 };
 
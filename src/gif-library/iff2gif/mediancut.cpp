@@ -95,6 +95,7 @@ class MedianCut : public Quantizer
 public:
 	MedianCut(int maxcolors);
 	void AddPixels(const uint8_t *rgb, size_t count) override;
+	void AddWeightedPixels(const uint8_t *rgb, const uint32_t *weights, size_t count) override;
 	Palette GetPalette() override;
 
 private:
@@ -128,6 +129,15 @@ void MedianCut::AddPixels(const uint8_t *rgb, size_t count)
 	Bins[0].Count += (uint32_t)count;
 }
 
+void MedianCut::AddWeightedPixels(const uint8_t *rgb, const uint32_t *weights, size_t count)
+{
+	Histo.AddPixels(rgb, weights, count, Bins[0].Mins, Bins[0].Maxs);
+	for (size_t i = 0; i < count; ++i)
+	{
+		Bins[0].Count += weights[i];
+	}
+}
+
 Palette MedianCut::GetPalette()
 {
 	if (Histo.size() <= MaxColors)
@@ -205,7 +215,9 @@ Palette MedianCut::CalcPalette()
 			: (median + bin.Maxs[splitdim]) / 2;
 		if (splitpt == bin.Mins[splitdim])
 			splitpt++;
+#ifdef _DEBUG
 		printf("Split bin %d (pop %u) @ %d on dim %d\n", binnum, bin.Count, splitpt, splitdim);
+#endif
 		uint32_t newbin = (uint32_t)Bins.size();
 		Bins.emplace_back(bin.Split(Histo, splitdim, splitpt));
 		CheckBounds(binnum, Bins[binnum]);
@@ -378,6 +378,11 @@ public:
 		histo.AddPixels(rgb, count, nullptr, nullptr);
 	}
 
+	void AddWeightedPixels(const uint8_t *rgb, const uint32_t *weights, size_t count) override
+	{
+		histo.AddPixels(rgb, weights, count, nullptr, nullptr);
+	}
+
 	Palette GetPalette() override {
 		if (histo.empty())
 		{
@@ -52,18 +52,25 @@ Palette Histogram::ToPalette() const
 // Count all the unique colors in an image and optionally computes the 3D bounding box for those colors.
 void Histogram::AddPixels(const uint8_t *src, size_t numpixels, uint8_t mins[3], uint8_t maxs[3])
 {
-	for (size_t j = numpixels; j > 0; --j, src += 4)
+	AddPixels(src, nullptr, numpixels, mins, maxs);
+}
+
+void Histogram::AddPixels(const uint8_t *src, const uint32_t *weights, size_t numpixels, uint8_t mins[3], uint8_t maxs[3])
+{
+	for (size_t j = 0; j < numpixels; ++j, src += 4)
 	{
+		uint32_t weight = weights ? weights[j] : 1;
 		uint32_t color = *reinterpret_cast<const uint32_t *>(src);
 		auto it = ColorToHisto.find(color);
 		if (it != ColorToHisto.end())
 		{
-			Histo[it->second].Count++;
+			Histo[it->second].Count += weight;
 		}
 		else
 		{
 			ColorToHisto[color] = Histo.size();
 			Histo.emplace_back(src[0], src[1], src[2]);
+			Histo.back().Count = weight;
 		}
 		if (mins && maxs)
 		{
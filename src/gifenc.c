@@ -12,8 +12,11 @@
 #include <unistd.h>
 #endif
 
+/* size of the output buffer (initial size for memory output) */
+#define OUT_SIZE (256 << 10)
+
 /* helper to write a little-endian 16-bit number portably */
-#define write_num(fd, n) write((fd), (uint8_t []) {(n) & 0xFF, (n) >> 8}, 2)
+#define write_num(gif, n) put_bytes((gif), (uint8_t []) {(n) & 0xFF, (n) >> 8}, 2)
 
 static uint8_t vga[0x30] = {
     0x00, 0x00, 0x00,
@@ -34,45 +37,94 @@ static uint8_t vga[0x30] = {
     0xFF, 0xFF, 0xFF,
 };
 
-struct Node {
-    uint16_t key;
-    struct Node *children[];
+/* The LZW dictionary is a hash table of (prefix code << 8 | pixel) -> code
+ * with linear probing. DICT_SIZE is twice the 4096 codes GIF allows, so
+ * probe runs stay short. An entry is valid only if its stamp is the current
+ * generation, so clearing the dictionary just starts a new generation. */
+#define DICT_BITS 13
+#define DICT_SIZE (1 << DICT_BITS)
+
+struct ge_Dict {
+    uint32_t key[DICT_SIZE];
+    uint16_t code[DICT_SIZE];
+    uint16_t stamp[DICT_SIZE];
+    uint16_t generation;
 };
-typedef struct Node Node;
 
-static Node *
-new_node(uint16_t key, int degree)
+static void
+clear_dict(ge_Dict *dict)
 {
-    Node *node = calloc(1, sizeof(*node) + degree * sizeof(Node *));
-    if (node)
-        node->key = key;
-    return node;
+    if (++dict->generation == 0) {
+        memset(dict->stamp, 0, sizeof(dict->stamp));
+        dict->generation = 1;
+    }
 }
 
-static Node *
-new_trie(int degree, int *nkeys)
+/* Returns the slot holding key, or the free slot where it belongs. */
+static int
+find_slot(const ge_Dict *dict, uint32_t key)
 {
-    Node *root = new_node(0, degree);
-    /* Create nodes for single pixels. */
-    for (*nkeys = 0; *nkeys < degree; (*nkeys)++)
-        root->children[*nkeys] = new_node(*nkeys, degree);
-    *nkeys += 2; /* skip clear code and stop code */
-    return root;
+    int slot = (key * 2654435761u) >> (32 - DICT_BITS);
+    while (dict->stamp[slot] == dict->generation && dict->key[slot] != key)
+        slot = (slot + 1) & (DICT_SIZE - 1);
+    return slot;
 }
 
+/* Hand the buffered output to the sink: the fd (until everything is
+ * written), the callback, or nowhere for memory output, which grows instead.
+ * The first failure is kept in gif->error and later output is dropped. */
 static void
-del_trie(Node *root, int degree)
+flush_out(ge_GIF *gif)
 {
-    if (!root)
+    size_t done = 0;
+    if (gif->error || !gif->outlen)
+        goto flushed;
+    if (gif->sink) {
+        if (gif->sink(gif->sink_ctx, gif->out, gif->outlen) != 0)
+            gif->error = 1;
+    } else if (gif->fd >= 0) {
+        while (done < gif->outlen) {
+            ssize_t n = write(gif->fd, gif->out + done, gif->outlen - done);
+            if (n <= 0) {
+                gif->error = 1;
+                break;
+            }
+            done += n;
+        }
+    } else {
         return;
-    for (int i = 0; i < degree; i++)
-        del_trie(root->children[i], degree);
-    free(root);
+    }
+flushed:
+    gif->outlen = 0;
+}
+
+static void
+put_bytes(ge_GIF *gif, const void *src, size_t n)
+{
+    if (gif->outlen + n > gif->outcap) {
+        flush_out(gif);
+        if (gif->outlen + n > gif->outcap) {
+            /* memory output */
+            size_t cap = gif->outcap;
+            uint8_t *out;
+            while (cap < gif->outlen + n)
+                cap *= 2;
+            out = realloc(gif->out, cap);
+            if (!out) {
+                gif->error = 1;
+                return;
+            }
+            gif->out = out;
+            gif->outcap = cap;
+        }
+    }
+    memcpy(gif->out + gif->outlen, src, n);
+    gif->outlen += n;
 }
 
-#define write_and_store(s, dst, fd, src, n) \
+#define write_and_store(s, dst, gif, src, n) \
 do { \
-    write(fd, src, n); \
+    put_bytes(gif, src, n); \
     if (s) { \
         memcpy(dst, src, n); \
         dst += n; \
@@ -80,36 +132,95 @@ do { \
 } while (0);
 
 static void put_loop(ge_GIF *gif, uint16_t loop);
+static ge_GIF *new_gif(
+    int fd, ge_write_fn sink, void *ctx, uint16_t width, uint16_t height,
+    uint8_t *palette, int depth, int bgindex, int loop
+);
 
 ge_GIF *
 ge_new_gif(
     const char *fname, uint16_t width, uint16_t height,
     uint8_t *palette, int depth, int bgindex, int loop
 )
+{
+    ge_GIF *gif;
+#ifdef _WIN32
+    int fd = creat(fname, S_IWRITE);
+#else
+    int fd = creat(fname, 0666);
+#endif
+    if (fd == -1)
+        return NULL;
+    gif = ge_new_gif_fd(fd, width, height, palette, depth, bgindex, loop);
+    if (!gif)
+        close(fd);
+    return gif;
+}
+
+ge_GIF *
+ge_new_gif_fd(
+    int fd, uint16_t width, uint16_t height,
+    uint8_t *palette, int depth, int bgindex, int loop
+)
+{
+#ifdef _WIN32
+    setmode(fd, O_BINARY);
+#endif
+    return new_gif(fd, NULL, NULL, width, height, palette, depth, bgindex, loop);
+}
+
+ge_GIF *
+ge_new_gif_cb(
+    ge_write_fn sink, void *ctx, uint16_t width, uint16_t height,
+    uint8_t *palette, int depth, int bgindex, int loop
+)
+{
+    return new_gif(-1, sink, ctx, width, height, palette, depth, bgindex, loop);
+}
+
+ge_GIF *
+ge_new_gif_mem(
+    uint16_t width, uint16_t height,
+    uint8_t *palette, int depth, int bgindex, int loop
+)
+{
+    return new_gif(-1, NULL, NULL, width, height, palette, depth, bgindex, loop);
+}
+
+static ge_GIF *
+new_gif(
+    int fd, ge_write_fn sink, void *ctx, uint16_t width, uint16_t height,
+    uint8_t *palette, int depth, int bgindex, int loop
+)
 {
     int i, r, g, b, v;
     int store_gct, custom_gct;
     int nbuffers = bgindex < 0 ? 2 : 1;
     ge_GIF *gif = calloc(1, sizeof(*gif) + nbuffers*width*height);
     if (!gif)
-        goto no_gif;
+        return NULL;
+    gif->out = malloc(OUT_SIZE);
+    if (!gif->out) {
+        free(gif);
+        return NULL;
+    }
+    gif->outcap = OUT_SIZE;
+    gif->dict = calloc(1, sizeof(*gif->dict));
+    if (!gif->dict) {
+        free(gif->out);
+        free(gif);
+        return NULL;
+    }
     gif->w = width; gif->h = height;
     gif->bgindex = bgindex;
     gif->frame = (uint8_t *) &gif[1];
     gif->back = &gif->frame[width*height];
-#ifdef _WIN32
-    gif->fd = creat(fname, S_IWRITE);
-#else
-    gif->fd = creat(fname, 0666);
-#endif
-    if (gif->fd == -1)
-        goto no_fd;
-#ifdef _WIN32
-    setmode(gif->fd, O_BINARY);
-#endif
-    write(gif->fd, "GIF89a", 6);
-    write_num(gif->fd, width);
-    write_num(gif->fd, height);
+    gif->fd = fd;
+    gif->sink = sink;
+    gif->sink_ctx = ctx;
+    put_bytes(gif, "GIF89a", 6);
+    write_num(gif, width);
+    write_num(gif, height);
     store_gct = custom_gct = 0;
     if (palette) {
         if (depth < 0)
@@ -120,18 +231,18 @@ ge_new_gif(
     if (depth < 0)
         depth = -depth;
     gif->depth = depth > 1 ? depth : 2;
-    write(gif->fd, (uint8_t []) {0xF0 | (depth-1), (uint8_t) bgindex, 0x00}, 3);
+    put_bytes(gif, (uint8_t []) {0xF0 | (depth-1), (uint8_t) bgindex, 0x00}, 3);
     if (custom_gct) {
-        write(gif->fd, palette, 3 << depth);
+        put_bytes(gif, palette, 3 << depth);
     } else if (depth <= 4) {
-        write_and_store(store_gct, palette, gif->fd, vga, 3 << depth);
+        write_and_store(store_gct, palette, gif, vga, 3 << depth);
     } else {
-        write_and_store(store_gct, palette, gif->fd, vga, sizeof(vga));
+        write_and_store(store_gct, palette, gif, vga, sizeof(vga));
         i = 0x10;
         for (r = 0; r < 6; r++) {
             for (g = 0; g < 6; g++) {
                 for (b = 0; b < 6; b++) {
-                    write_and_store(store_gct, palette, gif->fd,
+                    write_and_store(store_gct, palette, gif,
                       ((uint8_t []) {r*51, g*51, b*51}), 3
                     );
                     if (++i == 1 << depth)
@@ -141,7 +252,7 @@ ge_new_gif(
         }
         for (i = 1; i <= 24; i++) {
             v = i * 0xFF / 25;
-            write_and_store(store_gct, palette, gif->fd,
+            write_and_store(store_gct, palette, gif,
               ((uint8_t []) {v, v, v}), 3
             );
         }
@@ -150,20 +261,16 @@ done_gct:
     if (loop >= 0 && loop <= 0xFFFF)
         put_loop(gif, (uint16_t) loop);
     return gif;
-no_fd:
-    free(gif);
-no_gif:
-    return NULL;
 }
 
 static void
 put_loop(ge_GIF *gif, uint16_t loop)
 {
-    write(gif->fd, (uint8_t []) {'!', 0xFF, 0x0B}, 3);
-    write(gif->fd, "NETSCAPE2.0", 11);
-    write(gif->fd, (uint8_t []) {0x03, 0x01}, 2);
-    write_num(gif->fd, loop);
-    write(gif->fd, "\0", 1);
+    put_bytes(gif, (uint8_t []) {'!', 0xFF, 0x0B}, 3);
+    put_bytes(gif, "NETSCAPE2.0", 11);
+    put_bytes(gif, (uint8_t []) {0x03, 0x01}, 2);
+    write_num(gif, loop);
+    put_bytes(gif, "\0", 1);
 }
 
 /* Add packed key to buffer, updating offset and partial.
@@ -180,8 +287,9 @@ put_key(ge_GIF *gif, uint16_t key, int key_size)
     while (bits_to_write >= 8) {
         gif->buffer[byte_offset++] = gif->partial & 0xFF;
         if (byte_offset == 0xFF) {
-            write(gif->fd, "\xFF", 1);
-            write(gif->fd, gif->buffer, 0xFF);
+            if (!gif->raw)
+                put_bytes(gif, "\xFF", 1);
+            put_bytes(gif, gif->buffer, 0xFF);
             byte_offset = 0;
         }
         gif->partial >>= 8;
@@ -198,55 +306,92 @@ end_key(ge_GIF *gif)
     if (gif->offset % 8)
         gif->buffer[byte_offset++] = gif->partial & 0xFF;
     if (byte_offset) {
-        write(gif->fd, (uint8_t []) {byte_offset}, 1);
-        write(gif->fd, gif->buffer, byte_offset);
+        put_bytes(gif, (uint8_t []) {byte_offset}, 1);
+        put_bytes(gif, gif->buffer, byte_offset);
     }
-    write(gif->fd, "\0", 1);
+    put_bytes(gif, "\0", 1);
     gif->offset = gif->partial = 0;
 }
 
-static void
-put_image(ge_GIF *gif, uint16_t w, uint16_t h, uint16_t x, uint16_t y)
+/* LZW-codes the w x h pixels at `pixels` (rows `stride` bytes apart),
+ * starting from a clear dictionary. Writes neither the clear code before nor
+ * the stop code after; returns the code size the decoder reads them at. */
+static int
+put_codes(ge_GIF *gif, const uint8_t *pixels, int stride, uint16_t w, uint16_t h)
 {
-    int nkeys, key_size, i, j;
-    Node *node, *child, *root;
+    int nkeys, key_size, i, j, slot;
+    int prefix = -1;
+    uint32_t key;
+    ge_Dict *dict = gif->dict;
     int degree = 1 << gif->depth;
 
-    write(gif->fd, ",", 1);
-    write_num(gif->fd, x);
-    write_num(gif->fd, y);
-    write_num(gif->fd, w);
-    write_num(gif->fd, h);
-    write(gif->fd, (uint8_t []) {0x00, gif->depth}, 2);
-    root = node = new_trie(degree, &nkeys);
+    clear_dict(dict);
+    nkeys = degree + 2; /* single pixels, clear code and stop code */
     key_size = gif->depth + 1;
-    put_key(gif, degree, key_size); /* clear code */
-    for (i = y; i < y+h; i++) {
-        for (j = x; j < x+w; j++) {
-            uint8_t pixel = gif->frame[i*gif->w+j] & (degree - 1);
-            child = node->children[pixel];
-            if (child) {
-                node = child;
+    for (i = 0; i < h; i++) {
+        for (j = 0; j < w; j++) {
+            uint8_t pixel = pixels[(size_t) i*stride+j] & (degree - 1);
+            if (prefix < 0) {
+                prefix = pixel;
+                continue;
+            }
+            key = (uint32_t) prefix << 8 | pixel;
+            slot = find_slot(dict, key);
+            if (dict->stamp[slot] == dict->generation) {
+                prefix = dict->code[slot];
+                continue;
+            }
+            put_key(gif, prefix, key_size);
+            if (nkeys < 0x1000) {
+                if (nkeys == (1 << key_size))
+                    key_size++;
+                dict->key[slot] = key;
+                dict->code[slot] = nkeys++;
+                dict->stamp[slot] = dict->generation;
             } else {
-                put_key(gif, node->key, key_size);
-                if (nkeys < 0x1000) {
-                    if (nkeys == (1 << key_size))
-                        key_size++;
-                    node->children[pixel] = new_node(nkeys++, degree);
-                } else {
-                    put_key(gif, degree, key_size); /* clear code */
-                    del_trie(root, degree);
-                    root = node = new_trie(degree, &nkeys);
-                    key_size = gif->depth + 1;
-                }
-                node = root->children[pixel];
+                put_key(gif, degree, key_size); /* clear code */
+                clear_dict(dict);
+                nkeys = degree + 2;
+                key_size = gif->depth + 1;
             }
+            prefix = pixel;
         }
     }
-    put_key(gif, node->key, key_size);
+    put_key(gif, prefix, key_size);
+    /* The decoder adds an entry on reading that last code (we never do), and
+     * widens its codes if that fills the current size. */
+    if (nkeys == (1 << key_size) && key_size < 12)
+        key_size++;
+    return key_size;
+}
+
+static void
+put_descriptor(ge_GIF *gif, uint16_t w, uint16_t h, uint16_t x, uint16_t y)
+{
+    put_bytes(gif, ",", 1);
+    write_num(gif, x);
+    write_num(gif, y);
+    write_num(gif, w);
+    write_num(gif, h);
+    put_bytes(gif, (uint8_t []) {0x00, gif->depth}, 2);
+}
+
+/* Encodes the w x h pixels at `pixels` (rows `stride` bytes apart) as the
+ * image at (x, y). */
+static void
+put_image(
+    ge_GIF *gif, uint16_t w, uint16_t h, uint16_t x, uint16_t y,
+    const uint8_t *pixels, int stride
+)
+{
+    int degree = 1 << gif->depth;
+    int key_size;
+
+    put_descriptor(gif, w, h, x, y);
+    put_key(gif, degree, gif->depth + 1); /* clear code */
+    key_size = put_codes(gif, pixels, stride, w, h);
     put_key(gif, degree + 1, key_size); /* stop code */
     end_key(gif);
-    del_trie(root, degree);
 }
 
 static int
@@ -279,13 +424,20 @@ get_bbox(ge_GIF *gif, uint16_t *w, uint16_t *h, uint16_t *x, uint16_t *y)
     }
 }
 
+/* transparent < 0 for none */
+static void
+put_graphics_control(ge_GIF *gif, uint16_t d, int disposal, int transparent)
+{
+    uint8_t flags = (disposal << 2) | (transparent >= 0);
+    put_bytes(gif, (uint8_t []) {'!', 0xF9, 0x04, flags}, 4);
+    write_num(gif, d);
+    put_bytes(gif, (uint8_t []) {(uint8_t) (transparent >= 0 ? transparent : 0), 0x00}, 2);
+}
+
 static void
 add_graphics_control_extension(ge_GIF *gif, uint16_t d)
 {
-    uint8_t flags = ((gif->bgindex >= 0 ? 2 : 1) << 2) + 1;
-    write(gif->fd, (uint8_t []) {'!', 0xF9, 0x04, flags}, 4);
-    write_num(gif->fd, d);
-    write(gif->fd, (uint8_t []) {(uint8_t) gif->bgindex, 0x00}, 2);
+    put_graphics_control(gif, d, gif->bgindex >= 0 ? 2 : 1, (uint8_t) gif->bgindex);
 }
 
 void
@@ -305,7 +457,7 @@ ge_add_frame(ge_GIF *gif, uint16_t delay)
         w = h = 1;
         x = y = 0;
     }
-    put_image(gif, w, h, x, y);
+    put_image(gif, w, h, x, y, &gif->frame[y*gif->w+x], gif->w);
     gif->nframes++;
     if (gif->bgindex < 0) {
         tmp = gif->back;
@@ -315,9 +467,165 @@ ge_add_frame(ge_GIF *gif, uint16_t delay)
 }
 
 void
+ge_add_frame_rect(ge_GIF *gif, uint16_t delay, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    put_graphics_control(gif, delay, 1, -1);
+    put_image(gif, w, h, x, y, &gif->frame[y*gif->w+x], gif->w);
+    gif->nframes++;
+}
+
+/* Sets up `enc` to encode into memory with the settings of `gif`. */
+static int
+new_encoder(ge_GIF *enc, const ge_GIF *gif)
+{
+    memset(enc, 0, sizeof(*enc));
+    enc->depth = gif->depth;
+    enc->fd = -1;
+    enc->out = malloc(OUT_SIZE);
+    enc->outcap = OUT_SIZE;
+    enc->dict = calloc(1, sizeof(*enc->dict));
+    if (!enc->out || !enc->dict) {
+        free(enc->out);
+        free(enc->dict);
+        return 0;
+    }
+    return 1;
+}
+
+uint8_t *
+ge_encode_frame_rect(
+    const ge_GIF *gif, uint16_t delay, uint16_t x, uint16_t y,
+    uint16_t w, uint16_t h, int transparent, const uint8_t *pixels,
+    size_t *size
+)
+{
+    ge_GIF enc;
+    if (!new_encoder(&enc, gif))
+        return NULL;
+    put_graphics_control(&enc, delay, 1, transparent);
+    put_image(&enc, w, h, x, y, pixels, w);
+    free(enc.dict);
+    if (enc.error) {
+        free(enc.out);
+        return NULL;
+    }
+    *size = enc.outlen;
+    return enc.out;
+}
+
+struct ge_Band {
+    uint8_t *bits;
+    size_t nbits;
+    int key_size;
+};
+
+ge_Band *
+ge_encode_band(const ge_GIF *gif, const uint8_t *pixels, uint16_t w, uint16_t h)
+{
+    ge_GIF enc;
+    ge_Band *band = malloc(sizeof(*band));
+    if (!band || !new_encoder(&enc, gif)) {
+        free(band);
+        return NULL;
+    }
+    enc.raw = 1;
+    band->key_size = put_codes(&enc, pixels, w, w, h);
+    /* whole bytes go out, the last bits stay in enc.partial */
+    put_bytes(&enc, enc.buffer, enc.offset / 8);
+    band->nbits = enc.outlen * 8 + enc.offset % 8;
+    if (enc.offset % 8)
+        put_bytes(&enc, (uint8_t []) {enc.partial & 0xFF}, 1);
+    free(enc.dict);
+    if (enc.error) {
+        free(enc.out);
+        free(band);
+        return NULL;
+    }
+    band->bits = enc.out;
+    return band;
+}
+
+void
+ge_free_band(ge_Band *band)
+{
+    if (band) {
+        free(band->bits);
+        free(band);
+    }
+}
+
+uint8_t *
+ge_encode_frame_bands(
+    const ge_GIF *gif, uint16_t delay, uint16_t x, uint16_t y,
+    uint16_t w, uint16_t h, int transparent, ge_Band *const *bands,
+    int nbands, size_t *size
+)
+{
+    ge_GIF enc;
+    int degree = 1 << gif->depth;
+    int key_size = gif->depth + 1;
+    int i;
+    size_t k;
+    if (!new_encoder(&enc, gif))
+        return NULL;
+    put_graphics_control(&enc, delay, 1, transparent);
+    put_descriptor(&enc, w, h, x, y);
+    for (i = 0; i < nbands; i++) {
+        const ge_Band *band = bands[i];
+        /* The clear code goes out at the code size the decoder has reached
+         * after the previous band's last code. */
+        put_key(&enc, degree, key_size);
+        for (k = 0; k + 8 <= band->nbits; k += 8)
+            put_key(&enc, band->bits[k / 8], 8);
+        if (k < band->nbits)
+            put_key(&enc, band->bits[k / 8] & ((1 << (band->nbits - k)) - 1), band->nbits - k);
+        key_size = band->key_size;
+    }
+    put_key(&enc, degree + 1, key_size); /* stop code */
+    end_key(&enc);
+    free(enc.dict);
+    if (enc.error) {
+        free(enc.out);
+        return NULL;
+    }
+    *size = enc.outlen;
+    return enc.out;
+}
+
+void
+ge_add_encoded_frame(ge_GIF *gif, const uint8_t *data, size_t size)
+{
+    put_bytes(gif, data, size);
+    gif->nframes++;
+}
+
+int
 ge_close_gif(ge_GIF* gif)
 {
-    write(gif->fd, ";", 1);
-    close(gif->fd);
+    int error;
+    put_bytes(gif, ";", 1);
+    flush_out(gif);
+    error = gif->error;
+    if (gif->fd >= 0 && close(gif->fd) != 0)
+        error = 1;
+    free(gif->dict);
+    free(gif->out);
+    free(gif);
+    return error ? -1 : 0;
+}
+
+uint8_t *
+ge_close_gif_mem(ge_GIF *gif, size_t *size)
+{
+    uint8_t *out = NULL;
+    put_bytes(gif, ";", 1);
+    if (!gif->error) {
+        out = gif->out;
+        *size = gif->outlen;
+    } else {
+        free(gif->out);
+    }
+    free(gif->dict);
     free(gif);
+    return out;
 }
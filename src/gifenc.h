@@ -1,17 +1,31 @@
 #ifndef GIFENC_H
 #define GIFENC_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Receives the encoded bytes; returns 0 on success. */
+typedef int (*ge_write_fn)(void *ctx, const uint8_t *data, size_t size);
+
+typedef struct ge_Dict ge_Dict;
+typedef struct ge_Band ge_Band;
+
 typedef struct ge_GIF {
     uint16_t w, h;
     int depth;
     int bgindex;
     int fd;
+    ge_write_fn sink;
+    void *sink_ctx;
+    uint8_t *out;
+    size_t outlen, outcap;
+    int error;
+    int raw;
+    ge_Dict *dict;
     int offset;
     int nframes;
     uint8_t *frame, *back;
@@ -23,8 +37,61 @@ ge_GIF *ge_new_gif(
     const char *fname, uint16_t width, uint16_t height,
     uint8_t *palette, int depth, int bgindex, int loop
 );
+/* Same as ge_new_gif, but writes to an already open file descriptor (e.g. a
+ * pipe). The descriptor is closed by ge_close_gif, but not on failure. */
+ge_GIF *ge_new_gif_fd(
+    int fd, uint16_t width, uint16_t height,
+    uint8_t *palette, int depth, int bgindex, int loop
+);
+/* Same as ge_new_gif, but hands the output to `sink` (with `ctx`) in large
+ * chunks. */
+ge_GIF *ge_new_gif_cb(
+    ge_write_fn sink, void *ctx, uint16_t width, uint16_t height,
+    uint8_t *palette, int depth, int bgindex, int loop
+);
+/* Same as ge_new_gif, but keeps the whole output in memory; get it with
+ * ge_close_gif_mem. */
+ge_GIF *ge_new_gif_mem(
+    uint16_t width, uint16_t height,
+    uint8_t *palette, int depth, int bgindex, int loop
+);
 void ge_add_frame(ge_GIF *gif, uint16_t delay);
-void ge_close_gif(ge_GIF* gif);
+/* Adds a frame that only updates the rectangle (x, y, w, h): that part of
+ * gif->frame is encoded and the rest of the previous frame stays on screen
+ * (disposal 1, no transparency). gif->frame must hold the whole canvas; it
+ * is left as is, so the caller can keep painting into it. */
+void ge_add_frame_rect(ge_GIF *gif, uint16_t delay, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+/* Encodes the same kind of frame as ge_add_frame_rect into a separate block
+ * of bytes (to be freed with free), taking the w x h pixels of the rectangle
+ * from `pixels` instead of gif->frame. Pixels of palette index `transparent`
+ * (if >= 0) leave the previous frame showing. Only reads the GIF's settings,
+ * so frames can be encoded on several threads at once and added in order
+ * with ge_add_encoded_frame. Returns NULL if memory ran out. */
+uint8_t *ge_encode_frame_rect(
+    const ge_GIF *gif, uint16_t delay, uint16_t x, uint16_t y,
+    uint16_t w, uint16_t h, int transparent, const uint8_t *pixels,
+    size_t *size
+);
+void ge_add_encoded_frame(ge_GIF *gif, const uint8_t *data, size_t size);
+/* A large frame can also be LZW-coded in horizontal bands, each on its own
+ * thread: ge_encode_band codes the w x h pixels of one band from a clear
+ * dictionary, and ge_encode_frame_bands joins the bands (top to bottom) into
+ * a frame like ge_encode_frame_rect makes, with a clear code before each
+ * band. The bands are not freed. Each band costs a little compression, as
+ * its dictionary starts out empty. Both return NULL if memory ran out. */
+ge_Band *ge_encode_band(const ge_GIF *gif, const uint8_t *pixels, uint16_t w, uint16_t h);
+uint8_t *ge_encode_frame_bands(
+    const ge_GIF *gif, uint16_t delay, uint16_t x, uint16_t y,
+    uint16_t w, uint16_t h, int transparent, ge_Band *const *bands,
+    int nbands, size_t *size
+);
+void ge_free_band(ge_Band *band);
+/* Output is buffered (256 KiB at a time), so it is only complete once the
+ * GIF is closed. Returns -1 if any write failed, 0 otherwise. */
+int ge_close_gif(ge_GIF* gif);
+/* Closes a GIF made by ge_new_gif_mem and returns its bytes (to be freed
+ * with free), or NULL if memory ran out. */
+uint8_t *ge_close_gif_mem(ge_GIF *gif, size_t *size);
 
 #ifdef __cplusplus
 }
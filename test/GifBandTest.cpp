@@ -0,0 +1,76 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "gifenc.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Frames LZW-coded in bands (ge_encode_band + ge_encode_frame_bands) must
+// decode to exactly their pixels. Some widths used to start the next band
+// with a clear code of the wrong size.
+
+static bool CheckBands(int width, int height, int nbands, uint32_t seed) {
+    std::vector<uint8_t> palette(3 * 256);
+    for (int i = 0; i < 256; i++) {
+        palette[3 * i] = (uint8_t)i;
+        palette[3 * i + 1] = (uint8_t)(255 - i);
+        palette[3 * i + 2] = (uint8_t)(i * 7);
+    }
+    std::vector<uint8_t> pixels((size_t)width * height);
+    for (uint8_t &p : pixels) {
+        seed = seed * 1664525u + 1013904223u;
+        p = (uint8_t)(seed >> 24);
+    }
+
+    ge_GIF *gif = ge_new_gif_mem(width, height, palette.data(), 8, -1, -1);
+    if (!gif) return false;
+    std::vector<ge_Band *> bands;
+    for (int i = 0; i < nbands; i++) {
+        int row = height * i / nbands, rows = height * (i + 1) / nbands - row;
+        bands.push_back(ge_encode_band(gif, &pixels[(size_t)row * width], width, rows));
+    }
+    size_t size = 0;
+    uint8_t *frame = ge_encode_frame_bands(gif, 0, 0, 0, width, height, -1, bands.data(), nbands, &size);
+    for (ge_Band *band : bands) ge_free_band(band);
+    if (!frame) return false;
+    ge_add_encoded_frame(gif, frame, size);
+    free(frame);
+    uint8_t *data = ge_close_gif_mem(gif, &size);
+    if (!data) return false;
+
+    int *delays = nullptr;
+    int w = 0, h = 0, frames = 0, comp = 0;
+    stbi_uc *rgba = stbi_load_gif_from_memory(data, (int)size, &delays, &w, &h, &frames, &comp, 4);
+    free(data);
+    if (!rgba) {
+        std::cerr << "lebar " << width << ", " << nbands << " pita: " << stbi_failure_reason() << "\n";
+        return false;
+    }
+    bool ok = w == width && h == height && frames == 1;
+    for (size_t i = 0; ok && i < pixels.size(); i++) {
+        ok = rgba[4 * i] == palette[3 * pixels[i]] && rgba[4 * i + 1] == palette[3 * pixels[i] + 1];
+    }
+    stbi_image_free(rgba);
+    stbi_image_free(delays);
+    if (!ok) std::cerr << "lebar " << width << ", " << nbands << " pita: piksel berbeda\n";
+    return ok;
+}
+
+int main() {
+    int failures = 0;
+    for (int width = 1; width <= 320; width++) {
+        for (int nbands = 2; nbands <= 3; nbands++) {
+            if (!CheckBands(width, 2 * nbands, nbands, (uint32_t)width)) failures++;
+        }
+    }
+    // Bands long enough to fill the dictionary up to 4096 codes
+    if (!CheckBands(1000, 40, 4, 1)) failures++;
+    if (failures) {
+        std::cerr << failures << " frame gagal\n";
+        return 1;
+    }
+    std::cout << "OK\n";
+    return 0;
+}
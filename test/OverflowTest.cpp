@@ -0,0 +1,92 @@
+#include "Metrics.hpp"
+#include "QuadTreeCodec.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Overflow boundaries of the 64-bit sums and indices. The large images are
+// virtual: one row with stride 0, so every row points at the same memory
+// and no gigapixel buffer is allocated.
+
+static int failures = 0;
+
+static void Check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "GAGAL: " << what << "\n";
+        failures++;
+    }
+}
+
+static void NoFree(void *) {}
+
+static ImageBuffer VirtualImage(std::vector<uint8_t> &row, int width, int height, RGBPixel color) {
+    row.resize((size_t)width * 3);
+    for (size_t i = 0; i < row.size(); i += 3) {
+        row[i] = color.r;
+        row[i + 1] = color.g;
+        row[i + 2] = color.b;
+    }
+    ImageBuffer image;
+    image.Adopt(row.data(), width, height, 3, 0, NoFree);
+    return image;
+}
+
+static bool SameColor(const RGBPixel &a, const RGBPixel &b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+// 255 * 4200 * 4200 > 2^32: 32-bit sums would wrap.
+static void AverageColorSums() {
+    std::vector<uint8_t> row;
+    RGBPixel color(255, 254, 1);
+    ImageBuffer image = VirtualImage(row, 4200, 4200, color);
+    Check(SameColor(CalculateAverageColor(image, 0, 0, 4200, 4200), color), "rata-rata warna 4200x4200");
+    Check(CalculateMeanAbsoluteDeviation(image, 0, 0, 4200, 4200, color) == 0, "MAD 4200x4200");
+}
+
+// 65536 * 32769 > 2^31 pixels: int products would overflow.
+static void AverageColorPastInt() {
+    std::vector<uint8_t> row;
+    RGBPixel color(200, 100, 50);
+    ImageBuffer image = VirtualImage(row, 65536, 32769, color);
+    Check(SameColor(CalculateAverageColor(image, 0, 0, 65536, 32769), color), "rata-rata warna 65536x32769");
+}
+
+// A 65535x65535 tree (more than 2^32 pixels) must round-trip through every
+// coding; QTC_RANGE predicts the last child's color from color x area sums
+// beyond 2^32.
+static void CodecRoundTrip() {
+    const int side = 65535;
+    for (QuadTreeCoding coding : {QTC_RAW, QTC_RANGE, QTC_PROGRESSIVE}) {
+        auto root = std::make_unique<QuadTreeNode>(0, 0, side, side, RGBPixel(120, 130, 140), false);
+        for (int k = 0; k < 4; k++) {
+            int cx, cy, cw, ch;
+            ChildRect(0, 0, side, side, k, cx, cy, cw, ch);
+            root->Child(k) = std::make_unique<QuadTreeNode>(cx, cy, cw, ch, RGBPixel(90 + 20 * k, 130, 200 - 20 * k), true);
+        }
+        std::stringstream stream;
+        Check(EncodeQuadTree(stream, root, side, side, coding), "encode coding " + std::to_string(coding));
+        int width = 0, height = 0;
+        std::unique_ptr<QuadTreeNode> decoded = DecodeQuadTree(stream, width, height);
+        bool ok = decoded && width == side && height == side && !decoded->isLeaf;
+        for (int k = 0; ok && k < 4; k++) {
+            QuadTreeNode *a = root->Child(k).get(), *b = decoded->Child(k).get();
+            ok = b && b->isLeaf && b->width == a->width && b->height == a->height && SameColor(a->color, b->color);
+        }
+        Check(ok, "bolak-balik coding " + std::to_string(coding));
+    }
+}
+
+int main() {
+    AverageColorSums();
+    AverageColorPastInt();
+    CodecRoundTrip();
+    if (failures) {
+        std::cerr << failures << " pemeriksaan gagal\n";
+        return 1;
+    }
+    std::cout << "OK\n";
+    return 0;
+}
@@ -0,0 +1,251 @@
+#include "QuadTreeCodec.hpp"
+#include "QuadTreeImage.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// A real BuildQuadTree tree (sides that are not powers of two, so odd splits
+// on many levels) must round-trip through every coding, any .qtp prefix
+// must decode to a coarser tree, and a partial, scaled .qti viewport must
+// follow RenderViewport's sampling rule.
+
+static int failures = 0;
+
+static void Check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "GAGAL: " << what << "\n";
+        failures++;
+    }
+}
+
+static bool SameColor(const RGBPixel &a, const RGBPixel &b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+static ImageBuffer TestImage(int width, int height) {
+    ImageBuffer image;
+    image.Resize(width, height);
+    uint32_t seed = 12345;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            uint8_t *p = image.Row(y) + (size_t)x * 3;
+            // Flat areas, gradients and noise, so leaves end up at many depths
+            bool noisy = x > width / 2 && y > height / 3;
+            p[0] = (uint8_t)(x < width / 3 ? 40 : x * 255 / width);
+            p[1] = (uint8_t)(y * 255 / height);
+            p[2] = (uint8_t)(noisy ? seed >> 24 : 90);
+        }
+    }
+    return image;
+}
+
+static std::unique_ptr<QuadTreeNode> TestTree(const ImageBuffer &image) {
+    return BuildQuadTree(image, 0, 0, image.width, image.height, 6.0, 1, 2);
+}
+
+static int Depth(QuadTreeNode *node) {
+    int depth = 0;
+    for (int k = 0; node && !node->isLeaf && k < 4; k++) {
+        depth = std::max(depth, 1 + Depth(node->Child(k).get()));
+    }
+    return depth;
+}
+
+// First output pixel whose center lies at or after source coordinate `edge`.
+static int64_t OutputEdge(int64_t edge, int64_t viewStart, int64_t viewLength, int64_t outLength) {
+    int64_t num = 2 * (edge - viewStart) * outLength - viewLength, den = 2 * viewLength;
+    int64_t o = num >= 0 ? (num + den - 1) / den : -((-num) / den);
+    return std::max<int64_t>(0, std::min(o, outLength));
+}
+
+// The documented rule: follow the center of output pixel (ox, oy) down the
+// tree, stopping at a leaf or at a node that maps to that one pixel only.
+static QuadTreeNode *SampledNode(QuadTreeNode *node, int ox, int oy, int vx, int vy, int vw, int vh, int outWidth, int outHeight) {
+    double cx = vx + (ox + 0.5) * vw / outWidth, cy = vy + (oy + 0.5) * vh / outHeight;
+    while (!node->isLeaf) {
+        int64_t ox0 = OutputEdge(node->x, vx, vw, outWidth), ox1 = OutputEdge((int64_t)node->x + node->width, vx, vw, outWidth);
+        int64_t oy0 = OutputEdge(node->y, vy, vh, outHeight), oy1 = OutputEdge((int64_t)node->y + node->height, vy, vh, outHeight);
+        if (ox1 - ox0 == 1 && oy1 - oy0 == 1) {
+            break;
+        }
+        QuadTreeNode *next = nullptr;
+        for (int k = 0; k < 4 && !next; k++) {
+            QuadTreeNode *child = node->Child(k).get();
+            if (child && cx >= child->x && cx < child->x + child->width && cy >= child->y && cy < child->y + child->height) {
+                next = child;
+            }
+        }
+        node = next;
+    }
+    return node;
+}
+
+static void IndexedRoundTrip() {
+    ImageBuffer image = TestImage(203, 157);
+    std::unique_ptr<QuadTreeNode> root = TestTree(image);
+    Check(Depth(root.get()) >= 5, "pohon uji cukup dalam");
+    ImageBuffer reference;
+    reference.Resize(image.width, image.height);
+    reconstructImage(reference, root);
+
+    const std::string fileName = "QuadTreeCodecTest.qti";
+    {
+        std::ofstream out(fileName, std::ios::binary);
+        Check(EncodeQuadTree(out, root, image.width, image.height, QTC_INDEXED), "encode .qti");
+    }
+    IndexedQuadTreeFile indexed(fileName);
+    Check(indexed.Width() == image.width && indexed.Height() == image.height, "ukuran .qti");
+
+    // The whole image at 1:1 is exactly reconstructImage
+    std::vector<RGBPixel> full = indexed.RenderViewport(0, 0, image.width, image.height, image.width, image.height);
+    bool same = true;
+    for (int y = 0; same && y < image.height; y++) {
+        for (int x = 0; same && x < image.width; x++) {
+            const uint8_t *p = reference.Row(y) + (size_t)x * 3;
+            same = SameColor(full[(size_t)y * image.width + x], RGBPixel(p[0], p[1], p[2]));
+        }
+    }
+    Check(same, "viewport penuh 1:1 = reconstructImage");
+
+    // A partial, downscaled viewport
+    const int vx = 37, vy = 21, vw = 120, vh = 101, outWidth = 47, outHeight = 33;
+    std::vector<RGBPixel> view = indexed.RenderViewport(vx, vy, vw, vh, outWidth, outHeight);
+    int leaves = 0;
+    for (int oy = 0; oy < outHeight; oy++) {
+        for (int ox = 0; ox < outWidth; ox++) {
+            QuadTreeNode *node = SampledNode(root.get(), ox, oy, vx, vy, vw, vh, outWidth, outHeight);
+            RGBPixel expected = node->color;
+            if (node->isLeaf) {
+                // The leaf under the pixel's center, as reconstructImage paints it
+                int sx = (int)(vx + (ox + 0.5) * vw / outWidth), sy = (int)(vy + (oy + 0.5) * vh / outHeight);
+                const uint8_t *p = reference.Row(sy) + (size_t)sx * 3;
+                expected = RGBPixel(p[0], p[1], p[2]);
+                leaves++;
+            }
+            if (!SameColor(view[(size_t)oy * outWidth + ox], expected)) {
+                Check(false, "viewport sebagian piksel (" + std::to_string(ox) + ", " + std::to_string(oy) + ")");
+                oy = outHeight;
+                break;
+            }
+        }
+    }
+    Check(leaves > 0 && leaves < outWidth * outHeight, "viewport sebagian memakai daun dan simpul dalam");
+    std::remove(fileName.c_str());
+}
+
+// Same geometry, split flags and leaf colors; the colors of split nodes too
+// when `innerColors` is set.
+static bool SameTree(QuadTreeNode *a, QuadTreeNode *b, bool innerColors) {
+    if (!a || !b) {
+        return !a && !b;
+    }
+    if (a->x != b->x || a->y != b->y || a->width != b->width || a->height != b->height || a->isLeaf != b->isLeaf) {
+        return false;
+    }
+    if ((a->isLeaf || innerColors) && !SameColor(a->color, b->color)) {
+        return false;
+    }
+    for (int k = 0; !a->isLeaf && k < 4; k++) {
+        if (!SameTree(a->Child(k).get(), b->Child(k).get(), innerColors)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// `coarse` is the top of `full`: every node sits where a node of `full`
+// does, with its children split the same way, and a split node of `coarse`
+// is split in `full` too.
+static bool IsTopOf(QuadTreeNode *coarse, QuadTreeNode *full) {
+    if (!coarse || !full) {
+        return !coarse && !full;
+    }
+    if (coarse->x != full->x || coarse->y != full->y || coarse->width != full->width || coarse->height != full->height) {
+        return false;
+    }
+    if (coarse->isLeaf) {
+        return true;
+    }
+    if (full->isLeaf) {
+        return false;
+    }
+    for (int k = 0; k < 4; k++) {
+        if (!IsTopOf(coarse->Child(k).get(), full->Child(k).get())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint64_t CountNodes(QuadTreeNode *node) {
+    uint64_t count = node ? 1 : 0;
+    for (int k = 0; node && !node->isLeaf && k < 4; k++) {
+        count += CountNodes(node->Child(k).get());
+    }
+    return count;
+}
+
+static std::string Encode(std::unique_ptr<QuadTreeNode> &root, int width, int height, QuadTreeCoding coding) {
+    std::ostringstream out;
+    Check(EncodeQuadTree(out, root, width, height, coding), "encode coding " + std::to_string(coding));
+    return out.str();
+}
+
+static void AllCodingsRoundTrip() {
+    ImageBuffer image = TestImage(203, 157);
+    std::unique_ptr<QuadTreeNode> root = TestTree(image);
+    for (QuadTreeCoding coding : {QTC_RAW, QTC_RANGE, QTC_PROGRESSIVE, QTC_INDEXED}) {
+        std::string bytes = Encode(root, image.width, image.height, coding);
+        int width = 0, height = 0;
+        std::unique_ptr<QuadTreeNode> decoded = DecodeQuadTree((const uint8_t *)bytes.data(), bytes.size(), width, height);
+        Check(width == image.width && height == image.height, "ukuran coding " + std::to_string(coding));
+        // .qtc stores only the leaf colors
+        Check(SameTree(root.get(), decoded.get(), coding != QTC_RAW), "bolak-balik coding " + std::to_string(coding));
+    }
+}
+
+// Any prefix of a .qtp stream decodes to a valid, coarser tree, and longer
+// prefixes never give fewer nodes.
+static void ProgressivePrefixes() {
+    ImageBuffer image = TestImage(203, 157);
+    std::unique_ptr<QuadTreeNode> root = TestTree(image);
+    std::string bytes = Encode(root, image.width, image.height, QTC_PROGRESSIVE);
+    uint64_t fullCount = CountNodes(root.get()), lastCount = 0;
+    bool coarser = false;
+    for (size_t size = QTC_HEADER_SIZE + 3; size <= bytes.size(); size += std::max<size_t>(1, bytes.size() / 97)) {
+        int width = 0, height = 0;
+        std::unique_ptr<QuadTreeNode> decoded = DecodeQuadTree((const uint8_t *)bytes.data(), size, width, height);
+        uint64_t count = CountNodes(decoded.get());
+        if (!decoded || !SameColor(decoded->color, root->color) || !IsTopOf(decoded.get(), root.get()) || count < lastCount) {
+            Check(false, "prefix .qtp " + std::to_string(size) + " byte");
+            return;
+        }
+        coarser = coarser || (count > 1 && count < fullCount);
+        lastCount = count;
+    }
+    Check(coarser, "prefix .qtp memberi pohon yang lebih kasar");
+
+    // Fed in small chunks, the streaming decoder ends with the full tree
+    ProgressiveQuadTreeDecoder decoder;
+    for (size_t offset = 0; offset < bytes.size(); offset += 7) {
+        decoder.Feed((const uint8_t *)bytes.data() + offset, std::min<size_t>(7, bytes.size() - offset));
+    }
+    Check(decoder.Done() && SameTree(root.get(), decoder.Root().get(), true), "dekoder .qtp bertahap");
+}
+
+int main() {
+    AllCodingsRoundTrip();
+    ProgressivePrefixes();
+    IndexedRoundTrip();
+    if (failures) {
+        std::cerr << failures << " pemeriksaan gagal\n";
+        return 1;
+    }
+    std::cout << "OK\n";
+    return 0;
+}